@@ -0,0 +1,101 @@
+#include <assembler/debug_info.hpp>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+DebugInfo DebugInfo::from_file(std::string const& debug_info_file)
+{
+    auto file_contents = std::ifstream{debug_info_file, std::ios::in};
+    if (file_contents.fail()) {
+        throw std::runtime_error("Could not open file " + debug_info_file);
+    }
+    return DebugInfo::read(file_contents);
+}
+
+DebugInfo DebugInfo::read(std::istream& is)
+{
+    auto debug_info = DebugInfo{};
+    auto entry = std::string{};
+    while (std::getline(is, entry)) {
+        auto ss = std::stringstream{entry};
+        auto kind = std::string{};
+        ss >> kind;
+        if (kind == "file") {
+            ss >> std::ws;
+            std::getline(ss, debug_info.source_file);
+        } else if (kind == "line") {
+            auto addr = int{0};
+            auto source_line = SourceLine{};
+            ss >> std::hex >> addr >> std::dec >> source_line.line >> source_line.expanded_from;
+            debug_info.lines[addr] = source_line;
+        } else if (kind == "label") {
+            auto addr = int{0};
+            auto label = std::string{};
+            ss >> std::hex >> addr >> label;
+            debug_info.labels[label] = addr;
+        } else if (!kind.empty()) {
+            throw std::runtime_error("Unexpected debug info entry: " + entry);
+        }
+    }
+    return debug_info;
+}
+
+void DebugInfo::write(std::ostream& os) const
+{
+    os << "file " << this->source_file << "\n";
+    for (auto&& [addr, source_line] : this->lines) {
+        os << "line " << std::hex << addr << std::dec << " " << source_line.line;
+        if (!source_line.expanded_from.empty()) {
+            os << " " << source_line.expanded_from;
+        }
+        os << "\n";
+    }
+    for (auto&& [label, addr] : this->labels) {
+        os << "label " << std::hex << addr << std::dec << " " << label << "\n";
+    }
+}
+
+std::string DebugInfo::describe(Address addr) const
+{
+    auto source_line = this->lines.find(addr);
+    if (source_line == this->lines.end()) {
+        return "";
+    }
+    auto description = this->source_file + ":" + std::to_string(source_line->second.line);
+    if (!source_line->second.expanded_from.empty()) {
+        description += " (" + source_line->second.expanded_from + ")";
+    }
+    return description;
+}
+
+std::string DebugInfo::symbolize(Address addr) const
+{
+    auto label = this->closest_label(addr);
+    if (label == this->labels.end()) {
+        return "";
+    }
+    if (label->second == addr) {
+        return label->first;
+    }
+    std::stringstream ss;
+    ss << label->first << "+0x" << std::hex << (addr - label->second);
+    return ss.str();
+}
+
+std::string DebugInfo::label_of(Address addr) const
+{
+    auto label = this->closest_label(addr);
+    return label == this->labels.end() ? "" : label->first;
+}
+
+std::map<std::string, Address>::const_iterator DebugInfo::closest_label(Address addr) const
+{
+    auto closest = this->labels.end();
+    for (auto label = this->labels.begin(); label != this->labels.end(); ++label) {
+        if (label->second <= addr && (closest == this->labels.end() || label->second > closest->second)) {
+            closest = label;
+        }
+    }
+    return closest;
+}
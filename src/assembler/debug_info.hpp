@@ -0,0 +1,46 @@
+#ifndef MICRO16_DEBUG_INFO_HPP
+#define MICRO16_DEBUG_INFO_HPP
+
+#include <specs.h>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+
+// Maps code addresses back to the assembly source. Written by micro16_asm
+// as a side-car file, so that tools can symbolize addresses without parsing
+// the sources again.
+//
+// File format (one entry per line, addresses in hex):
+//     file <source file>
+//     line <address> <line> [<pseudo-instruction it was expanded from>]
+//     label <address> <name>
+class DebugInfo {
+public:
+    struct SourceLine {
+        int line;
+        std::string expanded_from;
+    };
+
+    static DebugInfo from_file(std::string const& debug_info_file);
+    static DebugInfo read(std::istream& is);
+    void write(std::ostream& os) const;
+
+    // e.g. "led_blink.m16asm:12" or "led_blink.m16asm:12 (SETREG)". Empty if unknown.
+    std::string describe(Address addr) const;
+
+    // Closest label at or before `addr`, e.g. "timer_interrupt_0+0x6". Empty if unknown.
+    std::string symbolize(Address addr) const;
+
+    // Closest label at or before `addr`, without the offset. Empty if unknown.
+    std::string label_of(Address addr) const;
+
+    std::string source_file;
+    std::map<Address, SourceLine> lines;
+    std::map<std::string, Address> labels;
+
+private:
+    std::map<std::string, Address>::const_iterator closest_label(Address addr) const;
+};
+
+#endif //MICRO16_DEBUG_INFO_HPP
@@ -47,6 +47,13 @@ std::vector<Token> Lexer::tokens_from_file(std::string const &input_file)
     return lex.generate_tokens();
 }
 
+std::vector<Token> Lexer::tokens_from_string(std::string const &source)
+{
+    auto source_stream = std::istringstream{source};
+    auto lex = Lexer{source_stream};
+    return lex.generate_tokens();
+}
+
 Lexer::Lexer(std::istream &ss) : ss(ss)
 {
 }
@@ -72,7 +79,7 @@ std::vector<Token> Lexer::generate_tokens()
         } else if (is_alpha(c)) {
             auto data = std::string{c};
             this->identifier(data);
-        } else if (is_digit(c)) {
+        } else if (is_digit(c) || (c == '-' && is_digit(this->peek_next()))) {
             auto data = std::string{c};
             this->number(data);
         } else if (c == '/') {
@@ -133,7 +140,7 @@ void Lexer::comment()
     auto c = this->next();
     if (c == '/') {
         // Single line comment
-        while (!is_linebreak(this->peek_next())) {
+        while (!is_linebreak(this->peek_next()) && this->peek_next() != EOF) {
             (void) this->next();
             continue;
         }
@@ -141,6 +148,9 @@ void Lexer::comment()
         // Comment block
         c = this->next();
         while (!(c == '*' && this->peek_next() == '/')) {
+            if (c == EOF) {
+                throw LexerError("Unterminated comment at line " + std::to_string(this->line), this->line);
+            }
             c = this->next();
             if (is_linebreak(c)) {
                 this->line += 1;
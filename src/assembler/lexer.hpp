@@ -46,6 +46,7 @@ struct Token {
 class Lexer {
 public:
     static std::vector<Token> tokens_from_file(std::string const &input_file);
+    static std::vector<Token> tokens_from_string(std::string const &source);
 
 private:
     explicit Lexer(std::istream &ss);
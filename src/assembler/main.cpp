@@ -12,6 +12,8 @@ int main(int argc, char** argv)
         .help("Micro16 ASM file (.m16asm)");
     arg_parser.add_argument("output_file")
         .help("Output binary (.micro16)");
+    arg_parser.add_argument("--debug-info")
+        .help("Also write the address to source line table to this file");
 
     try {
         arg_parser.parse_args(argc, argv);
@@ -23,6 +25,9 @@ int main(int argc, char** argv)
 
     auto input_file = arg_parser.get<std::string>("input_file");
     auto output_file = arg_parser.get<std::string>("output_file");
+    auto debug_info_file = arg_parser.present("--debug-info");
+    auto debug_info = DebugInfo{};
+    debug_info.source_file = input_file;
 
     auto tokens = [&]() -> decltype(Lexer::tokens_from_file(input_file)){
         try {
@@ -43,7 +48,7 @@ int main(int argc, char** argv)
     }();
     auto instructions = [&]() -> decltype(Parser::generate_instruction_list(tokens)) {
         try {
-            return Parser::generate_instruction_list(tokens);
+            return Parser::generate_instruction_list(tokens, &debug_info);
         } catch (ParserError const& err) {
             std::cerr << "In file " << output_file << ":\n";
             std::cerr << "|  " << err.what() << "\n";
@@ -69,6 +74,11 @@ int main(int argc, char** argv)
     auto out_stream = std::ofstream{output_file, std::ios::out | std::ios::binary};
     dump_instructions(instructions, out_stream);
 
+    if (debug_info_file) {
+        auto debug_info_stream = std::ofstream{*debug_info_file, std::ios::out};
+        debug_info.write(debug_info_stream);
+    }
+
     return 0;
 }
 
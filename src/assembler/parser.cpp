@@ -32,20 +32,47 @@ int extract_int(Token const& t, int nbits)
     }
 
     auto value = [&]() {
-        if (t.data.substr(0, 2) == "0b") {
-            return std::stoi(t.data.substr(2, t.data.size() - 2), nullptr, 2);
-        } else if (t.data.substr(0, 2) == "0x") {
-            return std::stoi(t.data.substr(2, t.data.size() - 2), nullptr, 16);
+        try {
+            if (t.data.substr(0, 2) == "0b") {
+                return std::stoi(t.data.substr(2, t.data.size() - 2), nullptr, 2);
+            } else if (t.data.substr(0, 2) == "0x") {
+                return std::stoi(t.data.substr(2, t.data.size() - 2), nullptr, 16);
+            }
+            return std::stoi(t.data, nullptr, 10);
+        } catch (std::logic_error&) {
+            // Missing digits (e.g. "0x") or out of range
+            auto msg = "[Parser error]: Invalid integer " + t.data + " at line " + std::to_string(t.line);
+            throw ParserError{msg, t};
         }
-        return std::stoi(t.data, nullptr, 10);
     }();
-    if (value < 0 || value > std::pow(2, nbits)) {
+    if (value < 0 || value >= std::pow(2, nbits)) {
         auto msg = "[Parser error]: Expected a " + std::to_string(nbits) + " value, but got " + t.data + "(" + std::to_string(value) + ")";
         throw ParserError{msg, t};
     }
     return value;
 }
 
+int extract_signed_int(Token const& t, int nbits)
+{
+    if (t.type != TokenType::INTEGER) {
+        unexpected_token(t, TokenType::INTEGER);
+    }
+
+    auto value = 0;
+    try {
+        value = std::stoi(t.data, nullptr, 10);
+    } catch (std::logic_error&) {
+        auto msg = "[Parser error]: Invalid integer " + t.data + " at line " + std::to_string(t.line);
+        throw ParserError{msg, t};
+    }
+    auto limit = 1 << (nbits - 1);
+    if (value < -limit || value >= limit) {
+        auto msg = "[Parser error]: Expected a signed " + std::to_string(nbits) + " bits value, but got " + t.data;
+        throw ParserError{msg, t};
+    }
+    return value & ((1 << nbits) - 1);
+}
+
 int extract_register(Token const& t)
 {
     if (t.type != TokenType::IDENTIFIER) {
@@ -105,31 +132,78 @@ private:
     std::vector<ResolverFunction> resolvers;
 };
 
-std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<Token> const& tokens)
+std::map<Position, Instruction> Parser::generate_instruction_list(
+    std::vector<Token> const& tokens,
+    DebugInfo* debug_info
+)
 {
     auto pos = Position{0x0000};
     auto instructions = std::map<Position, Instruction>{};
-    auto add_instruction = [&instructions, &pos](Instruction const& i) {
+    auto t = tokens.cbegin();
+    auto line = 0;
+    auto expanded_from = std::string{};
+    auto add_debug_line = [&debug_info, &line, &expanded_from](Position p) {
+        if (debug_info != nullptr) {
+            debug_info->lines[p] = {line, expanded_from};
+        }
+    };
+    auto add_instruction = [&instructions, &pos, &add_debug_line](Instruction const& i) {
         instructions[pos] = i;
+        add_debug_line(pos);
         pos += 2;
     };
-    auto t = tokens.cbegin();
-    auto next_reg = [&t]() {
+    auto next_token = [&t, &tokens]() -> Token const& {
+        auto previous = t;
         t = std::next(t);
-        return extract_register(*t);
+        if (t == tokens.cend()) {
+            auto msg = "[Parser error]: Unexpected end of file after \"" + previous->data + "\" at line " + std::to_string(previous->line);
+            throw ParserError{msg, *previous};
+        }
+        return *t;
     };
-    auto next_int = [&t](int size) {
-        t = std::next(t);
-        return extract_int(*t, size);
+    auto next_reg = [&next_token]() {
+        return extract_register(next_token());
     };
-    auto next_string = [&t]() {
-        t = std::next(t);
-        return extract_string(*t);
+    auto next_int = [&next_token](int size) {
+        return extract_int(next_token(), size);
+    };
+    auto next_signed_int = [&next_token](int size) {
+        return extract_signed_int(next_token(), size);
+    };
+    auto next_string = [&next_token]() {
+        return extract_string(next_token());
     };
 
     auto label_resolver = LabelResolver{};
 
+    // LDI, with either a value or a label
+    auto add_load_immediate = [&]() {
+        auto reg = next_reg();
+        next_token();
+        if (t->type == TokenType::INTEGER) {
+            add_instruction((LDI_CODE << 8) | (reg << 0));
+            add_instruction(extract_int(*t, 16));
+        } else if (t->type == TokenType::IDENTIFIER) {
+            auto label = extract_string(*t);
+            label_resolver.add_resolver([label, t, pos, &label_resolver, &instructions]() {
+                try {
+                    instructions[pos + 2] = label_resolver.get_label_position(label);
+                } catch (std::out_of_range&) {
+                    auto msg = "Could not find label '" + label + "'.";
+                    throw ParserError{msg, *t};
+                }
+            });
+            add_instruction((LDI_CODE << 8) | (reg << 0));
+            add_instruction(0x0000);
+        } else {
+            auto msg = "Expected either INTEGER or a label STRING";
+            throw ParserError{msg, *t};
+        }
+    };
+
     while(t != tokens.cend()) {
+        line = t->line;
+        expanded_from.clear();
         if (t->type == TokenType::IDENTIFIER) {
             if (t->data == "NOP") {
                 add_instruction((NOP_CODE << 8));
@@ -137,6 +211,20 @@ std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<To
                 add_instruction((ADD_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
             } else if (t->data == "SUB") {
                 add_instruction((SUB_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "ADC") {
+                add_instruction((ADC_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "SBC") {
+                add_instruction((SBC_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "MUL") {
+                add_instruction((MUL_CODE << 8) | (next_reg() << 6) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "DIV") {
+                add_instruction((DIV_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "MOD") {
+                add_instruction((MOD_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
+            } else if (t->data == "SHL") {
+                add_instruction((SHL_CODE << 8) | (next_reg() << 6) | (next_int(4) << 0));
+            } else if (t->data == "SHR") {
+                add_instruction((SHR_CODE << 8) | (next_reg() << 6) | (next_int(4) << 0));
             } else if (t->data == "AND") {
                 add_instruction((AND_CODE << 8) | (next_reg() << 4) | (next_reg() << 2) | (next_reg() << 0));
             } else if (t->data == "OR") {
@@ -149,6 +237,10 @@ std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<To
                 add_instruction((DEC_CODE << 8) | (next_reg() << 0));
             } else if (t->data == "SET") {
                 add_instruction((SET_CODE << 8) | (next_reg() << 6) | (next_int(2) << 4) | (next_int(4) << 0));
+            } else if (t->data == "LDI") {
+                add_load_immediate();
+            } else if (t->data == "ADDI") {
+                add_instruction((ADDI_CODE << 8) | (next_reg() << 6) | (next_signed_int(6) << 0));
             } else if (t->data == "CLR") {
                 add_instruction((CLR_CODE << 8) | (next_reg() << 0));
             } else if (t->data == "NOT") {
@@ -195,6 +287,10 @@ std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<To
                 add_instruction((DTI_CODE << 8) | (next_int(1) << 0));
             } else if (t->data == "ETI") {
                 add_instruction((ETI_CODE << 8) | (next_int(1) << 0));
+            } else if (t->data == "DII") {
+                add_instruction((DII_CODE << 8) | (next_int(2) << 0));
+            } else if (t->data == "EII") {
+                add_instruction((EII_CODE << 8) | (next_int(2) << 0));
             } else if (t->data == "SELB") {
                 add_instruction((SELB_CODE << 8) | (next_int(2) << 0));
             } else if (t->data == "BRK") {
@@ -205,42 +301,16 @@ std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<To
 
             /* Pseudo-instructions */
             else if (t->data == "SETREG") {
-                auto reg = next_reg();
-
-                t = std::next(t);
-                if (t->type == TokenType::INTEGER) {
-                    auto val = extract_int(*t, 16);
-                    add_instruction((SET_CODE << 8) | (reg << 6) | (3 << 4) | (((val & 0xf000) >> 12) << 0));
-                    add_instruction((SET_CODE << 8) | (reg << 6) | (2 << 4) | (((val & 0x0f00) >> 8) << 0));
-                    add_instruction((SET_CODE << 8) | (reg << 6) | (1 << 4) | (((val & 0x00f0) >> 4) << 0));
-                    add_instruction((SET_CODE << 8) | (reg << 6) | (0 << 4) | (((val & 0x000f) >> 0) << 0));
-                } else if (t->type == TokenType::IDENTIFIER) {
-                    auto label = extract_string(*t);
-                    label_resolver.add_resolver([label, t, reg, pos, &label_resolver, &instructions]() {
-                        auto val = [&]() {
-                            try {
-                                return label_resolver.get_label_position(label);
-                            } catch (std::out_of_range&) {
-                                auto msg = "Could not find label '" + label + "'.";
-                                throw ParserError{msg, *t};
-                            }
-                        }();
-                        instructions[pos + 0] = ((SET_CODE << 8) | (reg << 6) | (3 << 4) | (((val & 0xf000) >> 12) << 0));
-                        instructions[pos + 2] = ((SET_CODE << 8) | (reg << 6) | (2 << 4) | (((val & 0x0f00) >> 8) << 0));
-                        instructions[pos + 4] = ((SET_CODE << 8) | (reg << 6) | (1 << 4) | (((val & 0x00f0) >> 4) << 0));
-                        instructions[pos + 6] = ((SET_CODE << 8) | (reg << 6) | (0 << 4) | (((val & 0x000f) >> 0) << 0));
-                    });
-                    pos += 8;
-                } else {
-                    auto msg = "Expected either INTEGER or a label STRING";
-                    throw ParserError{msg, *t};
-                }
+                expanded_from = t->data;
+                add_load_immediate();
             } else if (t->data == "PUSHALL") {
+                expanded_from = t->data;
                 add_instruction((PUSH_CODE << 8) | (0b00 << 0));
                 add_instruction((PUSH_CODE << 8) | (0b01 << 0));
                 add_instruction((PUSH_CODE << 8) | (0b10 << 0));
                 add_instruction((PUSH_CODE << 8) | (0b11 << 0));
             } else if (t->data == "POPALL") {
+                expanded_from = t->data;
                 add_instruction((POP_CODE << 8) | (0b11 << 0));
                 add_instruction((POP_CODE << 8) | (0b10 << 0));
                 add_instruction((POP_CODE << 8) | (0b01 << 0));
@@ -258,10 +328,14 @@ std::map<Position, Instruction> Parser::generate_instruction_list(std::vector<To
                 pos = next_int(16);
             } else if (t->data == ".data") {
                 instructions[pos] = next_int(16);
+                add_debug_line(pos);
                 pos += 2;
             } else if (t->data == ".label") {
                 auto label = next_string();
                 label_resolver.add_label(label, pos);
+                if (debug_info != nullptr) {
+                    debug_info->labels[label] = pos;
+                }
             } else {
                 unknown_section_type(*t);
             }
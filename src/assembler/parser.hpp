@@ -2,6 +2,7 @@
 #define MICRO16_PARSER_HPP
 
 #include <assembler/lexer.hpp>
+#include <assembler/debug_info.hpp>
 #include <micro16.hpp>
 #include <string>
 #include <map>
@@ -17,7 +18,11 @@ public:
 using Position = uint16_t;
 class Parser {
 public:
-    static std::map<Position, Instruction> generate_instruction_list(std::vector<Token> const& tokens);
+    // If `debug_info` is given, it is filled with the source line of each instruction and the labels
+    static std::map<Position, Instruction> generate_instruction_list(
+        std::vector<Token> const& tokens,
+        DebugInfo* debug_info = nullptr
+    );
 };
 
 #endif //MICRO16_PARSER_HPP
@@ -0,0 +1,141 @@
+#include <blitter.hpp>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+    auto constexpr VIDEO_BYTES_PER_ROW = VIDEO_WIDTH / 2;
+
+    // Row buffers are padded, so that they can be processed 8 bytes at a time
+    auto constexpr ROW_BUFFER_SIZE = VIDEO_BYTES_PER_ROW + 8;
+    using RowBuffer = std::array<Byte, ROW_BUFFER_SIZE>;
+
+    auto constexpr LOW_BITS = uint64_t{0x7777777777777777};
+    auto constexpr HIGH_BIT = uint64_t{0x8888888888888888};
+
+    // 0xf on each nibble of `value` that is not zero, 0x0 otherwise.
+    // (x & 0x7) + 0x7 never carries out of the nibble, but sets its highest
+    // bit if any of the lower bits is set.
+    inline uint64_t non_zero_nibbles(uint64_t value)
+    {
+        auto high_bits = (((value & LOW_BITS) + LOW_BITS) | value) & HIGH_BIT;
+        return (high_bits >> 3) * 0xf;
+    }
+
+    inline uint64_t load_u64(Byte const* ptr)
+    {
+        uint64_t value;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    inline void store_u64(Byte* ptr, uint64_t value)
+    {
+        std::memcpy(ptr, &value, sizeof(value));
+    }
+}
+
+Blitter::Blitter(Micro16& mcu)
+    : mcu{mcu}
+    , registers{nullptr}
+{
+}
+
+void Blitter::connect_to_memory(Byte* memory_start)
+{
+    this->registers = memory_start;
+}
+
+bool Blitter::is_connected() const
+{
+    return this->registers != nullptr;
+}
+
+void Blitter::disconnect()
+{
+    this->registers = nullptr;
+}
+
+void Blitter::on_write(Address offset)
+{
+    if (offset != CONTROL && offset != CONTROL + 1) {
+        return;
+    }
+    auto control = load_word(this->registers + CONTROL);
+    if (!(control & CONTROL_START)) {
+        return;
+    }
+    store_word(this->registers + CONTROL, control & ~CONTROL_START);
+    this->blit();
+}
+
+void Blitter::blit()
+{
+    auto& bus = this->mcu.get_bus();
+    auto const* src = std::as_const(bus).bank(load_word(this->registers + SRC_BANK) & 0b11);
+    auto src_addr = load_word(this->registers + SRC_ADDR);
+    auto width = int{load_word(this->registers + WIDTH)};
+    auto height = int{load_word(this->registers + HEIGHT)};
+    auto x = int{static_cast<int16_t>(load_word(this->registers + DST_X))};
+    auto y = int{static_cast<int16_t>(load_word(this->registers + DST_Y))};
+    auto color_key = load_word(this->registers + COLOR_KEY);
+    auto src_pitch = (width + 1) / 2;
+
+    // Clip the sprite columns to the screen
+    auto first_col = std::max(0, -x);
+    auto last_col = std::min(width, VIDEO_WIDTH - x);
+    if (first_col >= last_col) {
+        return;
+    }
+    auto first_byte = (x + first_col) / 2;
+    auto n_bytes = (x + last_col - 1) / 2 - first_byte + 1;
+
+    // Nibbles of the destination bytes that are covered by the sprite
+    auto covered = RowBuffer{};
+    std::fill(covered.begin(), covered.begin() + n_bytes, 0xff);
+    if ((x + first_col) % 2 == 1) {
+        covered[0] &= 0x0f;
+    }
+    if ((x + last_col) % 2 == 1) {
+        covered[n_bytes - 1] &= 0xf0;
+    }
+
+    auto key_pattern = (color_key & 0xf) * uint64_t{0x1111111111111111};
+    auto use_color_key = (color_key & COLOR_KEY_ENABLE) != 0;
+
+    // Sprite byte holding the pixel drawn on the high nibble of `first_byte`.
+    // For odd x, that pixel is on the low nibble of the byte.
+    auto src_first_byte = (2 * first_byte - x) >> 1;
+
+    auto first_row = std::max(0, -y);
+    auto last_row = std::min(height, VIDEO_HEIGHT - y);
+    for (int row = first_row; row < last_row; ++row) {
+        auto row_addr = Address(src_addr + row * src_pitch + src_first_byte);
+
+        // Sprite pixels, aligned to the destination nibbles
+        auto pixels = RowBuffer{};
+        if (x % 2 == 0) {
+            for (int i = 0; i < n_bytes; ++i) {
+                pixels[i] = src[Address(row_addr + i)];
+            }
+        } else {
+            for (int i = 0; i < n_bytes; ++i) {
+                pixels[i] = (src[Address(row_addr + i)] << 4) | (src[Address(row_addr + i + 1)] >> 4);
+            }
+        }
+
+        auto video_addr = Address(VIDEO_ADDR + (y + row) * VIDEO_BYTES_PER_ROW + first_byte);
+        auto video = RowBuffer{};
+        std::memcpy(video.data(), bus.bank(MMIO_BANK) + video_addr, n_bytes);
+        for (int i = 0; i < n_bytes; i += 8) {
+            auto p = load_u64(pixels.data() + i);
+            auto mask = load_u64(covered.data() + i);
+            if (use_color_key) {
+                mask &= non_zero_nibbles(p ^ key_pattern);
+            }
+            auto v = load_u64(video.data() + i);
+            store_u64(video.data() + i, (v & ~mask) | (p & mask));
+        }
+        bus.write_block(MMIO_BANK, video_addr, video.data(), n_bytes);
+    }
+}
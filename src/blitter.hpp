@@ -0,0 +1,37 @@
+#ifndef MICRO16_BLITTER_HPP
+#define MICRO16_BLITTER_HPP
+
+#include <micro16.hpp>
+
+// Draws 4bit sprites from any bank into the video memory when the guest
+// writes the control register. See the Blitter section on the CPU manual.
+class Blitter : public Micro16::Adapter {
+public:
+    static auto constexpr SRC_BANK = 0x00;
+    static auto constexpr SRC_ADDR = 0x02;
+    static auto constexpr WIDTH = 0x04;
+    static auto constexpr HEIGHT = 0x06;
+    static auto constexpr DST_X = 0x08;
+    static auto constexpr DST_Y = 0x0a;
+    static auto constexpr COLOR_KEY = 0x0c;
+    static auto constexpr CONTROL = 0x0e;
+    static auto constexpr N_REGISTER_BYTES = 0x10;
+
+    static auto constexpr COLOR_KEY_ENABLE = 0x0010;
+    static auto constexpr CONTROL_START = 0x0001;
+
+    explicit Blitter(Micro16& mcu);
+
+    void connect_to_memory(Byte* memory_start) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void on_write(Address offset) override;
+
+private:
+    void blit();
+
+    Micro16& mcu;
+    Byte* registers;
+};
+
+#endif //MICRO16_BLITTER_HPP
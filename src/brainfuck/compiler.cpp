@@ -1,4 +1,5 @@
 #include <brainfuck/compiler.hpp>
+#include <algorithm>
 
 namespace bfc {
 
@@ -8,30 +9,44 @@ void dump_asm_repr(std::istream& source, std::ostream &ostream)
     auto generate_next_label = [&label_n]() { label_n++; return "_" + std::to_string(label_n); };
     auto label_stack = std::vector<std::string>{};
     auto emit = [&ostream](std::string const& instruction) { ostream << instruction << "\n"; };
+    // ADDI takes -32 to 31
+    auto emit_add = [&emit](std::string const& reg, int value) {
+        while (value != 0) {
+            auto step = std::clamp(value, -32, 31);
+            emit("ADDI " + reg + " " + std::to_string(step));
+            value -= step;
+        }
+    };
 
     source.seekg(0);
     for (auto i = 0; !source.eof(); ++i) {
         auto c = static_cast<char>(source.get());
+        // Runs of the same command are folded together
+        auto count = 1;
+        if (c == '+' || c == '-' || c == '<' || c == '>') {
+            while (source.peek() == c) {
+                (void) source.get();
+                count += 1;
+            }
+        }
         switch (c) {
             case '+': {
-                emit("INC W3");
+                emit_add("W3", count);
                 break;
             }
             case '-': {
-                emit("DEC W3");
+                emit_add("W3", -count);
                 break;
             }
             case '<': {
                 emit("ST W0 W3");
-                emit("DEC W0");
-                emit("DEC W0");
+                emit_add("W0", -2 * count);
                 emit("LD W0 W3");
                 break;
             }
             case '>': {
                 emit("ST W0 W3");
-                emit("INC W0");
-                emit("INC W0");
+                emit_add("W0", 2 * count);
                 emit("LD W0 W3");
                 break;
             }
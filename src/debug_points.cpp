@@ -0,0 +1,43 @@
+#include <debug_points.hpp>
+#include <algorithm>
+
+void DebugPoints::add_breakpoint(Address addr)
+{
+    this->breakpoints.set(addr);
+}
+
+void DebugPoints::remove_breakpoint(Address addr)
+{
+    this->breakpoints.reset(addr);
+}
+
+void DebugPoints::add_watchpoint(int bank_id, Address start, std::size_t size, int access)
+{
+    this->update_watchpoints(bank_id, start, size, access, true);
+}
+
+void DebugPoints::remove_watchpoint(int bank_id, Address start, std::size_t size, int access)
+{
+    this->update_watchpoints(bank_id, start, size, access, false);
+}
+
+bool DebugPoints::is_armed() const
+{
+    auto any_watch = [](auto const& watches) {
+        return std::any_of(watches.begin(), watches.end(), [](auto const& bits) { return bits.any(); });
+    };
+    return this->breakpoints.any() || any_watch(this->read_watches) || any_watch(this->write_watches);
+}
+
+void DebugPoints::update_watchpoints(int bank_id, Address start, std::size_t size, int access, bool value)
+{
+    auto end = std::min(std::size_t{start} + size, std::size_t{BANK_SIZE});
+    for (auto addr = std::size_t{start}; addr < end; ++addr) {
+        if (access & READ) {
+            this->read_watches[bank_id].set(addr, value);
+        }
+        if (access & WRITE) {
+            this->write_watches[bank_id].set(addr, value);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef MICRO16_DEBUG_POINTS_HPP
+#define MICRO16_DEBUG_POINTS_HPP
+
+#include <specs.h>
+#include <array>
+#include <bitset>
+#include <cstddef>
+
+// Host side breakpoints (by code address) and watchpoints (by bank and
+// address), one bit per address so checking one is a single bit test.
+class DebugPoints {
+public:
+    enum Access {
+        READ = 0x1,
+        WRITE = 0x2,
+    };
+
+    void add_breakpoint(Address addr);
+    void remove_breakpoint(Address addr);
+    // `access` is a combination of READ and WRITE
+    void add_watchpoint(int bank_id, Address start, std::size_t size, int access);
+    void remove_watchpoint(int bank_id, Address start, std::size_t size, int access);
+
+    // False once everything added has been removed
+    bool is_armed() const;
+
+    inline bool has_breakpoint(Address addr) const
+    {
+        return this->breakpoints.test(addr);
+    }
+
+    inline bool is_watched(int bank_id, Address addr, Access access) const
+    {
+        return (access == READ ? this->read_watches : this->write_watches)[bank_id].test(addr);
+    }
+
+private:
+    void update_watchpoints(int bank_id, Address start, std::size_t size, int access, bool value);
+
+    std::bitset<BANK_SIZE> breakpoints;
+    std::array<std::bitset<BANK_SIZE>, N_BANKS> read_watches;
+    std::array<std::bitset<BANK_SIZE>, N_BANKS> write_watches;
+};
+
+#endif //MICRO16_DEBUG_POINTS_HPP
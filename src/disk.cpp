@@ -0,0 +1,182 @@
+#include <disk.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Disk::Disk(Micro16& mcu, std::string const& image_file, bool asynchronous)
+    : mcu{mcu}
+    , registers{nullptr}
+    , image{nullptr}
+    , image_size{0}
+    , asynchronous{asynchronous}
+    , stopping{false}
+{
+    auto fd = open(image_file.c_str(), O_RDWR);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open disk image " + image_file);
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not read the size of disk image " + image_file);
+    }
+    this->image_size = file_stat.st_size;
+    if (this->image_size > 0) {
+        auto* mapping = mmap(nullptr, this->image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Could not map disk image " + image_file);
+        }
+        this->image = static_cast<Byte*>(mapping);
+    }
+    // The mapping stays valid after the file is closed
+    close(fd);
+
+    if (this->asynchronous) {
+        this->worker_thread = std::thread{worker, this};
+    }
+}
+
+Disk::~Disk()
+{
+    if (this->asynchronous) {
+        {
+            std::scoped_lock _{this->transfer_mutex};
+            this->stopping = true;
+        }
+        this->transfer_requested.notify_one();
+        this->worker_thread.join();
+    }
+    if (this->image != nullptr) {
+        munmap(this->image, this->image_size);
+    }
+}
+
+void Disk::connect_to_memory(Byte* memory_start)
+{
+    this->registers = memory_start;
+    store_word(this->registers + N_SECTORS, std::min(this->image_size / SECTOR_SIZE, std::size_t{0xffff}));
+    this->set_status(STATUS_READY);
+}
+
+bool Disk::is_connected() const
+{
+    return this->registers != nullptr;
+}
+
+void Disk::disconnect()
+{
+    std::scoped_lock _{this->transfer_mutex};
+    this->pending_transfer.reset();
+    this->registers = nullptr;
+}
+
+void Disk::on_write(Address offset)
+{
+    if (offset != CONTROL && offset != CONTROL + 1) {
+        return;
+    }
+    auto control = load_word(this->registers + CONTROL);
+    if (!(control & CONTROL_START)) {
+        return;
+    }
+    store_word(this->registers + CONTROL, control & ~CONTROL_START);
+    if (load_word(this->registers + STATUS) == STATUS_BUSY) {
+        return;
+    }
+
+    auto transfer = Transfer{
+        (control & CONTROL_WRITE) != 0,
+        load_word(this->registers + SECTOR),
+        load_word(this->registers + COUNT),
+        load_word(this->registers + BANK) & 0b11,
+        load_word(this->registers + ADDR),
+        {}
+    };
+    auto size = transfer.count * SECTOR_SIZE;
+    if (transfer.sector * SECTOR_SIZE + size > this->image_size || transfer.addr + size > BANK_SIZE ||
+        this->overlaps_registers(transfer.bank, transfer.addr, size)) {
+        this->finish_transfer(transfer, STATUS_ERROR);
+        return;
+    }
+    if (transfer.write) {
+        auto const* memory = std::as_const(this->mcu.get_bus()).bank(transfer.bank) + transfer.addr;
+        transfer.data.assign(memory, memory + size);
+    } else {
+        transfer.data.resize(size);
+    }
+    this->set_status(STATUS_BUSY);
+    if (!this->asynchronous) {
+        this->run_transfer(transfer);
+        this->finish_transfer(transfer, STATUS_READY);
+        return;
+    }
+
+    {
+        std::scoped_lock _{this->transfer_mutex};
+        this->pending_transfer = std::move(transfer);
+    }
+    this->transfer_requested.notify_one();
+}
+
+bool Disk::overlaps_registers(int bank, Address addr, std::size_t size) const
+{
+    if (bank != MMIO_BANK) {
+        return false;
+    }
+    auto registers_addr = std::size_t(this->registers - std::as_const(this->mcu.get_bus()).bank(MMIO_BANK));
+    return addr < registers_addr + N_REGISTER_BYTES && registers_addr < addr + size;
+}
+
+void Disk::run_transfer(Transfer& transfer)
+{
+    auto* sectors = this->image + transfer.sector * SECTOR_SIZE;
+    if (transfer.write) {
+        std::memcpy(sectors, transfer.data.data(), transfer.data.size());
+    } else {
+        std::memcpy(transfer.data.data(), sectors, transfer.data.size());
+    }
+}
+
+void Disk::finish_transfer(Transfer const& transfer, Register status)
+{
+    if (!this->is_connected()) {
+        return;
+    }
+    if (status == STATUS_READY && !transfer.write) {
+        this->mcu.get_bus().write_block(transfer.bank, transfer.addr, transfer.data.data(), transfer.data.size());
+    }
+    this->set_status(status);
+    this->mcu.raise_interrupt(DISK_INTERRUPT);
+}
+
+void Disk::set_status(Register status)
+{
+    store_word(this->registers + STATUS, status);
+}
+
+void Disk::worker(Disk* self)
+{
+    while (true) {
+        auto lock = std::unique_lock{self->transfer_mutex};
+        self->transfer_requested.wait(lock, [self]() {
+            return self->stopping || self->pending_transfer.has_value();
+        });
+        if (self->stopping) {
+            return;
+        }
+        auto transfer = std::move(*self->pending_transfer);
+        self->pending_transfer.reset();
+        lock.unlock();
+
+        self->run_transfer(transfer);
+        self->mcu.post_completion([self, transfer = std::move(transfer)]() {
+            self->finish_transfer(transfer, STATUS_READY);
+        });
+    }
+}
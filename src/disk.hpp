@@ -0,0 +1,80 @@
+#ifndef MICRO16_DISK_HPP
+#define MICRO16_DISK_HPP
+
+#include <micro16.hpp>
+#include <condition_variable>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Sector addressed disk, backed by a memory mapped host image file. Transfers
+// move whole sectors between the image and any memory bank. See the Disk
+// section on the CPU manual.
+class Disk : public Micro16::Adapter {
+public:
+    static auto constexpr SECTOR_SIZE = 512;
+
+    static auto constexpr SECTOR = 0x00;
+    static auto constexpr BANK = 0x02;
+    static auto constexpr ADDR = 0x04;
+    static auto constexpr COUNT = 0x06;
+    static auto constexpr CONTROL = 0x08;
+    static auto constexpr STATUS = 0x0a;
+    static auto constexpr N_SECTORS = 0x0c;
+    static auto constexpr N_REGISTER_BYTES = 0x10;
+
+    static auto constexpr CONTROL_START = 0x0001;
+    static auto constexpr CONTROL_WRITE = 0x0002;
+
+    static auto constexpr STATUS_READY = 0x0000;
+    static auto constexpr STATUS_BUSY = 0x0001;
+    static auto constexpr STATUS_ERROR = 0x0002;
+
+    // If `asynchronous` is set, transfers are done by a separate thread, and
+    // the CPU keeps running while they are in flight.
+    Disk(Micro16& mcu, std::string const& image_file, bool asynchronous = false);
+    ~Disk();
+
+    void connect_to_memory(Byte* memory_start) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void on_write(Address offset) override;
+
+private:
+    struct Transfer {
+        bool write;
+        std::size_t sector;
+        std::size_t count;
+        int bank;
+        Address addr;
+        // The sectors moved, so the image and the bus are never touched on
+        // the same thread
+        std::vector<Byte> data;
+    };
+
+    // Moves data between the image and the transfer. Runs on the worker
+    // thread, if any.
+    void run_transfer(Transfer& transfer);
+    // Transfers into the registers would start other transfers while the
+    // data is stored, so they are rejected
+    bool overlaps_registers(int bank, Address addr, std::size_t size) const;
+    // Writes the data read into memory, and raises the interrupt. Runs on the
+    // CPU thread.
+    void finish_transfer(Transfer const& transfer, Register status);
+    void set_status(Register status);
+    static void worker(Disk* self);
+
+    Micro16& mcu;
+    Byte* registers;
+    Byte* image;
+    std::size_t image_size;
+
+    bool asynchronous;
+    std::mutex transfer_mutex;
+    std::condition_variable transfer_requested;
+    std::optional<Transfer> pending_transfer;
+    bool stopping;
+    std::thread worker_thread;
+};
+
+#endif //MICRO16_DISK_HPP
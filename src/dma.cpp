@@ -0,0 +1,54 @@
+#include <dma.hpp>
+
+DMAController::DMAController(Micro16& mcu)
+    : mcu{mcu}
+    , registers{nullptr}
+    , in_transfer{false}
+{
+}
+
+void DMAController::connect_to_memory(Byte* memory_start)
+{
+    this->registers = memory_start;
+}
+
+bool DMAController::is_connected() const
+{
+    return this->registers != nullptr;
+}
+
+void DMAController::disconnect()
+{
+    this->registers = nullptr;
+}
+
+void DMAController::on_write(Address offset)
+{
+    if (this->in_transfer || (offset != CONTROL && offset != CONTROL + 1)) {
+        return;
+    }
+    auto control = load_word(this->registers + CONTROL);
+    if (!(control & CONTROL_START)) {
+        return;
+    }
+    store_word(this->registers + CONTROL, control & ~CONTROL_START);
+
+    auto& bus = this->mcu.get_bus();
+    auto dst_bank = load_word(this->registers + DST_BANK) & 0b11;
+    auto dst_addr = load_word(this->registers + DST_ADDR);
+    auto length = load_word(this->registers + LENGTH);
+    this->in_transfer = true;
+    if (control & CONTROL_FILL) {
+        auto value = static_cast<Byte>(load_word(this->registers + FILL_VALUE) & 0x00ff);
+        bus.fill(dst_bank, dst_addr, value, length);
+    } else {
+        auto src_bank = load_word(this->registers + SRC_BANK) & 0b11;
+        auto src_addr = load_word(this->registers + SRC_ADDR);
+        bus.copy(dst_bank, dst_addr, src_bank, src_addr, length);
+    }
+    this->in_transfer = false;
+    // A transfer into the control register doesn't start another one
+    store_word(this->registers + CONTROL, load_word(this->registers + CONTROL) & ~CONTROL_START);
+
+    this->mcu.raise_interrupt(DMA_INTERRUPT);
+}
@@ -0,0 +1,36 @@
+#ifndef MICRO16_DMA_HPP
+#define MICRO16_DMA_HPP
+
+#include <micro16.hpp>
+
+// Bank to bank copies and fills, done host-side when the guest writes the
+// control register. See the DMA section on the CPU manual.
+class DMAController : public Micro16::Adapter {
+public:
+    static auto constexpr SRC_BANK = 0x00;
+    static auto constexpr SRC_ADDR = 0x02;
+    static auto constexpr DST_BANK = 0x04;
+    static auto constexpr DST_ADDR = 0x06;
+    static auto constexpr LENGTH = 0x08;
+    static auto constexpr FILL_VALUE = 0x0a;
+    static auto constexpr CONTROL = 0x0c;
+    static auto constexpr N_REGISTER_BYTES = 0x10;
+
+    static auto constexpr CONTROL_START = 0x0001;
+    static auto constexpr CONTROL_FILL = 0x0002;
+
+    explicit DMAController(Micro16& mcu);
+
+    void connect_to_memory(Byte* memory_start) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void on_write(Address offset) override;
+
+private:
+    Micro16& mcu;
+    Byte* registers;
+    // Set during a transfer, which may write into the registers and call on_write again
+    bool in_transfer;
+};
+
+#endif //MICRO16_DMA_HPP
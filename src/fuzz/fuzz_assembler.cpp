@@ -0,0 +1,17 @@
+#include <assembler/lexer.hpp>
+#include <assembler/parser.hpp>
+#include <cstdint>
+
+// Assembles arbitrary text. Syntax errors are expected, anything else
+// (crashes, other exceptions, hangs) is a bug.
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, std::size_t size)
+{
+    auto source = std::string{reinterpret_cast<char const*>(data), size};
+    try {
+        auto tokens = Lexer::tokens_from_string(source);
+        Parser::generate_instruction_list(tokens);
+    } catch (LexerError const&) {
+    } catch (ParserError const&) {
+    }
+    return 0;
+}
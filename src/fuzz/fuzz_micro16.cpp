@@ -0,0 +1,42 @@
+#include <micro16.hpp>
+#include <input_log.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace {
+    constexpr auto MAX_INSTRUCTIONS = uint64_t{1000};
+
+    struct InstructionBudget {
+        Micro16& mcu;
+
+        inline void on_instruction(Address IP, Instruction instruction, Address next_IP)
+        {
+            if (this->mcu.get_instruction_count() == MAX_INSTRUCTIONS) {
+                this->mcu.force_halt();
+            }
+        }
+    };
+}
+
+// Runs an arbitrary code bank for up to MAX_INSTRUCTIONS. The CPU is only
+// built once: each run rewinds it to a checkpoint taken before the first one,
+// which copies back just the pages the previous run wrote. Replaying an empty
+// input log keeps timers from starting, so runs are deterministic.
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, std::size_t size)
+{
+    static auto no_inputs = InputLog{};
+    static auto mcu = []() {
+        auto mcu = std::make_unique<Micro16>(std::array<Byte, BANK_SIZE>{});
+        mcu->replay_inputs(no_inputs);
+        mcu->enable_checkpoints(std::numeric_limits<uint64_t>::max(), 1);
+        return mcu;
+    }();
+
+    mcu->rewind_to(0);
+    mcu->get_bus().write_block(CODE_BANK, 0x0000, data, std::min<std::size_t>(size, BANK_SIZE));
+    auto budget = InstructionBudget{*mcu};
+    mcu->run(budget);
+    return 0;
+}
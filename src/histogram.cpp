@@ -0,0 +1,45 @@
+#include <histogram.hpp>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram()
+    : buckets{}
+    , count(0)
+    , max(0)
+{
+}
+
+uint64_t LatencyHistogram::get_count() const
+{
+    return this->count.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds LatencyHistogram::get_max() const
+{
+    return std::chrono::nanoseconds{this->max.load(std::memory_order_relaxed)};
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const
+{
+    auto count = this->get_count();
+    if (count == 0) {
+        return std::chrono::nanoseconds{0};
+    }
+    auto rank = std::max(uint64_t{1}, uint64_t(std::ceil(p / 100.0 * double(count))));
+    auto seen = uint64_t{0};
+    for (int i = 0; i < N_BUCKETS; ++i) {
+        seen += this->buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::chrono::nanoseconds{lowest_value_of(i)};
+        }
+    }
+    return this->get_max();
+}
+
+uint64_t LatencyHistogram::lowest_value_of(int bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS) {
+        return uint64_t(bucket);
+    }
+    auto shift = bucket / SUB_BUCKETS - 1;
+    return uint64_t(bucket - SUB_BUCKETS * shift) << shift;
+}
@@ -0,0 +1,58 @@
+#ifndef MICRO16_HISTOGRAM_HPP
+#define MICRO16_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+// Histogram of durations with a bounded relative error (HDR style): values
+// are bucketed by their power of two and, within it, by their next
+// SUB_BUCKET_BITS bits, so percentiles are within ~3% of the recorded values.
+//
+// record() may be called from one thread while others read it.
+class LatencyHistogram {
+public:
+    static constexpr auto SUB_BUCKET_BITS = 5;
+    static constexpr auto SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr auto N_BUCKETS = 2 * SUB_BUCKETS + (63 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    inline void record(std::chrono::nanoseconds duration)
+    {
+        auto ns = uint64_t(std::max(duration.count(), int64_t{0}));
+        auto& bucket = this->buckets[bucket_of(ns)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        this->count.store(this->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (ns > this->max.load(std::memory_order_relaxed)) {
+            this->max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t get_count() const;
+    std::chrono::nanoseconds get_max() const;
+
+    // Lower bound of the bucket holding the given percentile (0-100). 0 if empty.
+    std::chrono::nanoseconds percentile(double p) const;
+
+    static inline int bucket_of(uint64_t ns)
+    {
+        if (ns < 2 * SUB_BUCKETS) {
+            return int(ns);
+        }
+        auto shift = std::bit_width(ns) - (SUB_BUCKET_BITS + 1);
+        return int(SUB_BUCKETS * shift + (ns >> shift));
+    }
+
+    static uint64_t lowest_value_of(int bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, N_BUCKETS> buckets;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> max;
+};
+
+#endif //MICRO16_HISTOGRAM_HPP
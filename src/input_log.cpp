@@ -0,0 +1,55 @@
+#include <input_log.hpp>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+InputLog InputLog::from_file(std::string const& input_log_file)
+{
+    auto file_contents = std::ifstream{input_log_file, std::ios::in};
+    if (file_contents.fail()) {
+        throw std::runtime_error("Could not open file " + input_log_file);
+    }
+    return InputLog::read(file_contents);
+}
+
+InputLog InputLog::read(std::istream& is)
+{
+    auto input_log = InputLog{};
+    auto line = std::string{};
+    while (std::getline(is, line)) {
+        auto ss = std::stringstream{line};
+        auto kind = std::string{};
+        auto entry = Entry{0, Type::HALT, 0};
+        ss >> kind >> entry.instruction_count >> std::hex >> entry.value;
+        if (kind == "interrupts") {
+            entry.type = Type::INTERRUPTS;
+        } else if (kind == "key") {
+            entry.type = Type::KEY;
+        } else if (kind == "halt") {
+            entry.type = Type::HALT;
+            entry.value = 0;
+        } else if (!kind.empty()) {
+            throw std::runtime_error("Unexpected input log entry: " + line);
+        } else {
+            continue;
+        }
+        input_log.entries.push_back(entry);
+    }
+    return input_log;
+}
+
+void InputLog::write(std::ostream& os) const
+{
+    for (auto&& entry : this->entries) {
+        switch (entry.type) {
+            case Type::INTERRUPTS: os << "interrupts "; break;
+            case Type::KEY: os << "key "; break;
+            case Type::HALT: os << "halt "; break;
+        }
+        os << entry.instruction_count;
+        if (entry.type != Type::HALT) {
+            os << " " << std::hex << entry.value << std::dec;
+        }
+        os << "\n";
+    }
+}
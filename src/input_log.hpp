@@ -0,0 +1,44 @@
+#ifndef MICRO16_INPUT_LOG_HPP
+#define MICRO16_INPUT_LOG_HPP
+
+#include <specs.h>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Inputs the CPU received from other threads, each with the number of
+// instructions executed before it was received. Replaying them at the same
+// counts reproduces a run exactly. See Micro16::record_inputs.
+//
+// File format (one entry per line, counts in decimal, values in hex):
+//     interrupts <instruction count> <newly pending interrupt bits>
+//     key <instruction count> <key event>
+//     halt <instruction count>
+class InputLog {
+public:
+    enum class Type {
+        INTERRUPTS,
+        KEY,
+        // Halted from another thread (e.g. the window was closed), after
+        // running `instruction_count` instructions
+        HALT,
+    };
+
+    struct Entry {
+        uint64_t instruction_count;
+        Type type;
+        Register value;
+
+        inline bool operator==(Entry const& other) const = default;
+    };
+
+    static InputLog from_file(std::string const& input_log_file);
+    static InputLog read(std::istream& is);
+    void write(std::ostream& os) const;
+
+    std::vector<Entry> entries;
+};
+
+#endif //MICRO16_INPUT_LOG_HPP
@@ -13,8 +13,18 @@ static constexpr Byte XOR_CODE{0x05};
 static constexpr Byte INC_CODE{0x06};
 static constexpr Byte DEC_CODE{0x07};
 static constexpr Byte SET_CODE{0x08};
+// Followed by the 16-bit value to load
+static constexpr Byte LDI_CODE{0x09};
 static constexpr Byte CLR_CODE{0x0A};
 static constexpr Byte NOT_CODE{0x0B};
+static constexpr Byte ADDI_CODE{0x0C};
+static constexpr Byte SHL_CODE{0x0D};
+static constexpr Byte SHR_CODE{0x0E};
+static constexpr Byte MUL_CODE{0x0F};
+static constexpr Byte DIV_CODE{0x10};
+static constexpr Byte MOD_CODE{0x11};
+static constexpr Byte ADC_CODE{0x12};
+static constexpr Byte SBC_CODE{0x13};
 
 // Branch instructions
 static constexpr Byte JMP_CODE{0x80};
@@ -43,6 +53,8 @@ static constexpr Byte EAI_CODE{0xC1};
 static constexpr Byte DTI_CODE{0xC2};
 static constexpr Byte ETI_CODE{0xC3};
 static constexpr Byte SELB_CODE{0xC4};
+static constexpr Byte DII_CODE{0xC5};
+static constexpr Byte EII_CODE{0xC6};
 static constexpr Byte BRK_CODE{0xFE};
 static constexpr Byte HLT_CODE{0xFF};
 
@@ -0,0 +1,86 @@
+#include <keyboard.hpp>
+#include <atomic>
+
+Keyboard::Keyboard(Micro16& mcu)
+    : mcu{mcu}
+    , input_memory{nullptr}
+    , has_new_events{false}
+{
+    mcu.set_key_event_handler([this](Register event) {
+        this->write_key_event(event);
+    });
+}
+
+void Keyboard::connect_to_memory(Byte* memory_start)
+{
+    std::scoped_lock _{this->input_memory_mutex};
+    this->input_memory = memory_start;
+}
+
+bool Keyboard::is_connected() const
+{
+    return this->input_memory != nullptr;
+}
+
+void Keyboard::disconnect()
+{
+    std::scoped_lock _{this->input_memory_mutex};
+    this->input_memory = nullptr;
+}
+
+bool Keyboard::push_key_event(Byte key_code, bool pressed)
+{
+    auto event = Register(key_code | (pressed ? KEY_PRESSED : 0));
+    switch (this->mcu.get_input_mode()) {
+        case Micro16::InputMode::LIVE: {
+            auto written = this->write_key_event(event);
+            std::scoped_lock _{this->input_memory_mutex};
+            this->has_new_events = this->has_new_events || written;
+            return written;
+        }
+        case Micro16::InputMode::RECORD: {
+            this->mcu.post_key_event(event);
+            std::scoped_lock _{this->input_memory_mutex};
+            this->has_new_events = true;
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+bool Keyboard::write_key_event(Register event)
+{
+    std::scoped_lock _{this->input_memory_mutex};
+    if (this->input_memory == nullptr) {
+        return false;
+    }
+
+    // Indexes are kept on the lower byte of each register, so that they can
+    // be read and written atomically by each side.
+    auto head = std::atomic_ref<Byte>{this->input_memory[HEAD + 1]};
+    auto tail = std::atomic_ref<Byte>{this->input_memory[TAIL + 1]};
+
+    auto current_head = head.load(std::memory_order_relaxed) % N_EVENTS;
+    auto next_head = (current_head + 1) % N_EVENTS;
+    if (next_head == tail.load(std::memory_order_acquire) % N_EVENTS) {
+        return false;
+    }
+
+    store_word(this->input_memory + EVENTS + 2 * current_head, event);
+    head.store(next_head, std::memory_order_release);
+    return true;
+}
+
+void Keyboard::flush()
+{
+    {
+        std::scoped_lock _{this->input_memory_mutex};
+        if (!this->has_new_events) {
+            return;
+        }
+        this->has_new_events = false;
+    }
+    this->mcu.raise_interrupt(KEYBOARD_INTERRUPT);
+}
@@ -0,0 +1,43 @@
+#ifndef MICRO16_KEYBOARD_HPP
+#define MICRO16_KEYBOARD_HPP
+
+#include <micro16.hpp>
+
+// Delivers key events to the guest through a ring buffer on the input area.
+// The host is the only writer of the head index and of the events, and the
+// guest is the only writer of the tail index. See the Keyboard section on the
+// CPU manual.
+class Keyboard : public Micro16::Adapter {
+public:
+    static auto constexpr HEAD = 0x00;
+    static auto constexpr TAIL = 0x02;
+    static auto constexpr EVENTS = 0x80;
+    static auto constexpr N_EVENTS = 64;
+
+    static auto constexpr KEY_PRESSED = 0x0100;
+
+    explicit Keyboard(Micro16& mcu);
+
+    void connect_to_memory(Byte* memory_start) override;
+    void disconnect() override;
+    bool is_connected() const override;
+
+    // Queues a key event, dropping it if the guest is lagging behind.
+    // Returns false if the event was dropped. While the CPU records its
+    // inputs, the event is queued by the CPU thread, and this returns true.
+    // While it replays them, events are always dropped.
+    bool push_key_event(Byte key_code, bool pressed);
+
+    // Raises the keyboard interrupt if events were queued since the last call
+    void flush();
+
+private:
+    bool write_key_event(Register event);
+
+    Micro16& mcu;
+    Byte* input_memory;
+    std::mutex input_memory_mutex;
+    bool has_new_events;
+};
+
+#endif //MICRO16_KEYBOARD_HPP
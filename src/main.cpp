@@ -1,13 +1,79 @@
 #include <micro16.hpp>
 #include <sdl_screen.hpp>
+#include <dma.hpp>
+#include <blitter.hpp>
+#include <keyboard.hpp>
+#include <disk.hpp>
+#include <profiler.hpp>
+#include <trace.hpp>
+#include <sampling_profiler.hpp>
+#include <trace_events.hpp>
+#include <stats_reporter.hpp>
+#include <assembler/debug_info.hpp>
 #include <argparse.hpp>
 #include <reader.hpp>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    int parse_number(std::string const& text, std::string const& option)
+    {
+        try {
+            return std::stoi(text, nullptr, 0);
+        } catch (std::logic_error&) {
+            throw std::runtime_error("Invalid number for " + option + ": " + text);
+        }
+    }
+}
 
 int main(int argc, char** argv)
 {
     argparse::ArgumentParser arg_parser("micro16");
     arg_parser.add_argument("input_file")
         .help("Binary file to run");
+    arg_parser.add_argument("--disk")
+        .help("Disk image file");
+    arg_parser.add_argument("--async-disk")
+        .help("Keep running the CPU while disk transfers are in flight")
+        .default_value(false)
+        .implicit_value(true);
+    arg_parser.add_argument("--profile")
+        .help("Count executions of each instruction, and write a report of the hottest ones to the given file");
+    arg_parser.add_argument("--trace")
+        .help("Record every executed instruction to the given file (see micro16_trace)");
+    arg_parser.add_argument("--sample")
+        .help("Periodically sample the guest call stack, and write the folded stacks to the given file");
+    arg_parser.add_argument("--sample-interval")
+        .help("Time between samples, in microseconds")
+        .scan<'i', int>()
+        .default_value(int(SamplingProfiler::DEFAULT_INTERVAL.count()));
+    arg_parser.add_argument("--trace-events")
+        .help("Record a timeline of CPU slices, interrupts and frames to the given file, as Chrome trace-event JSON");
+    arg_parser.add_argument("--stats")
+        .help("Print MIPS, FPS, frame times and timer interrupt latency to stderr periodically")
+        .default_value(false)
+        .implicit_value(true);
+    arg_parser.add_argument("--stats-json")
+        .help("Append the periodic statistics to the given file, as one JSON object per line");
+    arg_parser.add_argument("--stats-interval")
+        .help("Seconds between statistics reports")
+        .scan<'i', int>()
+        .default_value(5);
+    arg_parser.add_argument("--debug-info")
+        .help("Debug info written by micro16_asm, used to show labels and source lines in the reports");
+    arg_parser.add_argument("--record-inputs")
+        .help("Write the interrupts and key events received, and when, to the given file");
+    arg_parser.add_argument("--replay-inputs")
+        .help("Replay the inputs recorded with --record-inputs, instead of using timers and the keyboard");
+    arg_parser.add_argument("--break")
+        .help("Print the CPU state to stderr every time this address is reached. Can be repeated")
+        .append();
+    arg_parser.add_argument("--watch")
+        .help("Print the CPU state to stderr every time an instruction reads or writes BANK:ADDR[:SIZE]. Can be repeated")
+        .append();
 
     try {
         arg_parser.parse_args(argc, argv);
@@ -18,23 +84,200 @@ int main(int argc, char** argv)
     }
 
     auto input_file = arg_parser.get<std::string>("input_file");
+    auto profile_file = arg_parser.present("--profile");
+    auto trace_file = arg_parser.present("--trace");
+    auto sample_file = arg_parser.present("--sample");
+    auto trace_events_file = arg_parser.present("--trace-events");
+    auto n_probes = int(bool(profile_file)) + int(bool(trace_file)) + int(bool(sample_file)) + int(bool(trace_events_file));
+    if (n_probes > 1) {
+        std::cerr << "Only one of --profile, --trace, --sample and --trace-events can be used at a time" << std::endl;
+        return -1;
+    }
+    if (trace_events_file) {
+        // Before any thread is started, so all of them are named
+        TraceEvents::enable();
+        TraceEvents::set_thread_name("screen");
+    }
+    auto record_inputs_file = arg_parser.present("--record-inputs");
+    auto replay_inputs_file = arg_parser.present("--replay-inputs");
+    if (record_inputs_file && replay_inputs_file) {
+        std::cerr << "--record-inputs and --replay-inputs can't be used together" << std::endl;
+        return -1;
+    }
+    if ((record_inputs_file || replay_inputs_file) && arg_parser.get<bool>("--async-disk")) {
+        std::cerr << "Asynchronous disk transfers can't be recorded or replayed" << std::endl;
+        return -1;
+    }
+    auto input_log = InputLog{};
+    if (replay_inputs_file) {
+        input_log = InputLog::from_file(*replay_inputs_file);
+    }
+    auto debug_info = std::optional<DebugInfo>{};
+    if (auto debug_info_file = arg_parser.present("--debug-info")) {
+        debug_info = DebugInfo::from_file(*debug_info_file);
+    }
+
     Micro16 mcu{read_code_from_file(input_file)};
+    if (record_inputs_file) {
+        mcu.record_inputs(input_log);
+    } else if (replay_inputs_file) {
+        mcu.replay_inputs(input_log);
+    }
     SDLScreen monitor{};
+    DMAController dma{mcu};
+    Blitter blitter{mcu};
+    Keyboard keyboard{mcu};
+    std::optional<Disk> disk;
+    if (auto disk_file = arg_parser.present("--disk")) {
+        disk.emplace(mcu, *disk_file, arg_parser.get<bool>("--async-disk"));
+        mcu.register_mmio(*disk, Address{DISK_ADDR}, Disk::N_REGISTER_BYTES);
+    }
+
+    auto location_of = [&debug_info](Address addr) {
+        if (!debug_info) {
+            return std::string{};
+        }
+        auto label = debug_info->symbolize(addr);
+        return " at " + (label.empty() ? "" : label + " ") + debug_info->describe(addr);
+    };
+    auto breakpoints = arg_parser.present<std::vector<std::string>>("--break");
+    auto watchpoints = arg_parser.present<std::vector<std::string>>("--watch");
+    try {
+        for (auto&& addr : breakpoints.value_or(std::vector<std::string>{})) {
+            mcu.add_breakpoint(Address(parse_number(addr, "--break")));
+        }
+        for (auto&& watchpoint : watchpoints.value_or(std::vector<std::string>{})) {
+            auto fields = std::stringstream{watchpoint};
+            auto bank = std::string{};
+            auto addr = std::string{};
+            auto size = std::string{"1"};
+            std::getline(fields, bank, ':');
+            std::getline(fields, addr, ':');
+            std::getline(fields, size, ':');
+            auto access = DebugPoints::READ | DebugPoints::WRITE;
+            mcu.add_watchpoint(parse_number(bank, "--watch") & 0b11, Address(parse_number(addr, "--watch")),
+                               parse_number(size, "--watch"), access);
+        }
+    } catch (std::runtime_error const& err) {
+        std::cerr << err.what() << std::endl;
+        return -1;
+    }
+    if (breakpoints) {
+        mcu.set_address_breakpoint_handler([&location_of](Micro16::InternalState const& state, MemoryBus const&) {
+            std::cerr << "Breakpoint" << location_of(state.IP) << ": " << state << std::endl;
+        });
+    }
+    if (watchpoints) {
+        mcu.set_watchpoint_handler([&location_of](Micro16::InternalState const& state, MemoryBus const&, Micro16::MemoryAccess const& access) {
+            std::cerr << (access.type == DebugPoints::READ ? "Read 0x" : "Write 0x") << std::hex << access.value;
+            std::cerr << " at " << access.bank_id << ":0x" << access.addr << std::dec << location_of(state.IP) << ": " << state << std::endl;
+        });
+    }
 
     mcu.register_mmio(monitor, Address{0x0000});
+    monitor.connect_to_bus(mcu.get_bus());
+    mcu.register_mmio(dma, Address{DMA_ADDR}, DMAController::N_REGISTER_BYTES);
+    mcu.register_mmio(blitter, Address{BLITTER_ADDR}, Blitter::N_REGISTER_BYTES);
+    mcu.register_mmio(keyboard, Address{KEYBOARD_ADDR});
     monitor.register_on_window_close_callback([&mcu]() {
         mcu.force_halt();
     });
-    auto mcu_runner = std::thread{[&mcu]() {
-        mcu.run();
+    monitor.register_on_key_event_callback([&keyboard](Byte key_code, bool pressed) {
+        keyboard.push_key_event(key_code, pressed);
+    });
+    auto profiler = std::unique_ptr<ExecutionProfiler>{};
+    if (profile_file) {
+        profiler = std::make_unique<ExecutionProfiler>();
+    }
+    auto trace_recorder = std::unique_ptr<TraceRecorder>{};
+    if (trace_file) {
+        trace_recorder = std::make_unique<TraceRecorder>(mcu, *trace_file);
+    }
+    auto sampling_profiler = std::unique_ptr<SamplingProfiler>{};
+    if (sample_file) {
+        auto interval = std::chrono::microseconds{arg_parser.get<int>("--sample-interval")};
+        sampling_profiler = std::make_unique<SamplingProfiler>(interval);
+    }
+    auto trace_events_probe = std::unique_ptr<TraceEventsProbe>{};
+    if (trace_events_file) {
+        trace_events_probe = std::make_unique<TraceEventsProbe>();
+    }
+    auto stats_json_file = arg_parser.present("--stats-json");
+    auto stats_stream = std::ofstream{};
+    auto stats_reporter = std::unique_ptr<StatsReporter>{};
+    if (stats_json_file || arg_parser.get<bool>("--stats")) {
+        auto interval = std::chrono::seconds{arg_parser.get<int>("--stats-interval")};
+        if (stats_json_file) {
+            stats_stream.open(*stats_json_file, std::ios::out | std::ios::app);
+        }
+        auto& os = stats_json_file ? static_cast<std::ostream&>(stats_stream) : std::cerr;
+        auto format = stats_json_file ? StatsReporter::Format::JSON : StatsReporter::Format::TEXT;
+        stats_reporter = std::make_unique<StatsReporter>(mcu, monitor, os, format, interval);
+    }
+    auto mcu_runner = std::thread{[&mcu, &profiler, &trace_recorder, &sampling_profiler, &trace_events_probe]() {
+        if (profiler) {
+            mcu.run(*profiler);
+        } else if (trace_recorder) {
+            mcu.run(*trace_recorder);
+            trace_recorder->finish();
+        } else if (sampling_profiler) {
+            mcu.run(*sampling_profiler);
+            sampling_profiler->stop();
+        } else if (trace_events_probe) {
+            TraceEvents::set_thread_name("cpu");
+            mcu.run(*trace_events_probe);
+            trace_events_probe->end_slice();
+        } else {
+            mcu.run();
+        }
     }};
 
     while (monitor.is_connected()) {
         monitor.update();
+        keyboard.flush();
     }
     mcu_runner.join();
+    if (mcu.get_exit_reason() == Micro16::ExitReason::ILLEGAL_INSTRUCTION) {
+        auto state = mcu.get_state();
+        auto code = std::as_const(mcu.get_bus()).bank(CODE_BANK);
+        auto instruction = (code[state.IP] << 8) | code[Address(state.IP + 1)];
+        std::cerr << "Illegal instruction 0x" << std::hex << instruction << std::dec << location_of(state.IP) << ": " << state << std::endl;
+    }
+    if (record_inputs_file) {
+        auto input_log_stream = std::ofstream{*record_inputs_file};
+        input_log.write(input_log_stream);
+    }
+    if (stats_reporter) {
+        stats_reporter->stop();
+        stats_reporter->report();
+    }
+
+    if (profiler) {
+        auto symbolize = ExecutionProfiler::Symbolizer{};
+        if (debug_info) {
+            symbolize = [&debug_info](Address addr) {
+                return debug_info->symbolize(addr) + " " + debug_info->describe(addr);
+            };
+        }
+        auto report = std::ofstream{*profile_file};
+        profiler->write_report(report, std::as_const(mcu.get_bus()).bank(CODE_BANK), symbolize);
+    }
+    if (sampling_profiler) {
+        auto symbolize = SamplingProfiler::Symbolizer{};
+        if (debug_info) {
+            symbolize = [&debug_info](Address addr) {
+                return debug_info->label_of(addr);
+            };
+        }
+        auto folded_stacks = std::ofstream{*sample_file};
+        sampling_profiler->write_folded_stacks(folded_stacks, symbolize);
+    }
+    if (trace_events_file) {
+        auto trace_events = std::ofstream{*trace_events_file};
+        TraceEvents::write_json(trace_events);
+    }
 
-    return 0;
+    return mcu.get_exit_reason() == Micro16::ExitReason::ILLEGAL_INSTRUCTION ? 1 : 0;
 }
 
 
@@ -0,0 +1,264 @@
+#include <memory_bus.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    std::size_t host_page_size()
+    {
+        static auto const page_size = std::size_t(sysconf(_SC_PAGESIZE));
+        return page_size;
+    }
+}
+
+MemoryBus::MemoryBus()
+    : memory_banks{}
+    , page_flags{}
+    , saved_pages{nullptr}
+    , resident_size{0}
+{
+    for (int i = 0; i < N_BANKS; ++i) {
+        this->owned_banks[i] = MemoryBus::map_bank();
+        this->memory_banks[i] = this->owned_banks[i].get();
+        this->page_flags[i].fill(PAGE_UNTOUCHED);
+    }
+}
+
+MemoryBus::BankView MemoryBus::view(int bank_id)
+{
+    return {
+        bank_id,
+        this->memory_banks[bank_id],
+        this->page_flags[bank_id].data()
+    };
+}
+
+Byte const* MemoryBus::bank(int bank_id) const
+{
+    return this->memory_banks[bank_id];
+}
+
+Byte* MemoryBus::bank(int bank_id)
+{
+    if (this->is_shared(bank_id)) {
+        this->unshare(bank_id);
+    }
+    return this->memory_banks[bank_id];
+}
+
+void MemoryBus::share(int bank_id, std::shared_ptr<Bank const> memory)
+{
+    if (!this->is_shared(bank_id)) {
+        this->resident_size.fetch_sub(this->touched_size(bank_id), std::memory_order_relaxed);
+    }
+    this->owned_banks[bank_id].reset();
+    this->memory_banks[bank_id] = const_cast<Byte*>(memory->data());
+    this->shared_banks[bank_id] = std::move(memory);
+    for (auto& flags : this->page_flags[bank_id]) {
+        flags |= PAGE_SHARED | PAGE_UNTOUCHED;
+    }
+    if (this->remap_handler) {
+        this->remap_handler();
+    }
+}
+
+bool MemoryBus::is_shared(int bank_id) const
+{
+    return this->owned_banks[bank_id] == nullptr;
+}
+
+void MemoryBus::set_remap_handler(std::function<void()> const& handler)
+{
+    this->remap_handler = handler;
+}
+
+std::size_t MemoryBus::get_resident_size() const
+{
+    // Not mincore(), which also counts the pages only read: they are backed by
+    // the zero page, and never committed
+    return this->resident_size.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryBus::touched_size(int bank_id) const
+{
+    auto page_size = std::min(host_page_size(), std::size_t{BANK_SIZE});
+    auto const& flags = this->page_flags[bank_id];
+    auto size = std::size_t{0};
+    for (auto start = std::size_t{0}; start < BANK_SIZE; start += page_size) {
+        auto first = flags.begin() + start / PAGE_SIZE;
+        auto last = flags.begin() + (start + page_size) / PAGE_SIZE;
+        if (std::any_of(first, last, [](Byte page) { return !(page & PAGE_UNTOUCHED); })) {
+            size += page_size;
+        }
+    }
+    return size;
+}
+
+void MemoryBus::touch_pages(int bank_id, std::size_t start, std::size_t end)
+{
+    auto page_size = std::min(host_page_size(), std::size_t{BANK_SIZE});
+    auto& bank_flags = this->page_flags[bank_id];
+    for (auto page = start / PAGE_SIZE; page * PAGE_SIZE < end && page < N_PAGES; ++page) {
+        if (!(bank_flags[page] & PAGE_UNTOUCHED)) {
+            continue;
+        }
+        bank_flags[page] &= ~PAGE_UNTOUCHED;
+        if (this->is_shared(bank_id)) {
+            continue;
+        }
+        // The first page written on its host page commits it
+        auto first = bank_flags.begin() + (page * PAGE_SIZE / page_size) * (page_size / PAGE_SIZE);
+        auto last = first + page_size / PAGE_SIZE;
+        auto written = std::count_if(first, last, [](Byte flags) { return !(flags & PAGE_UNTOUCHED); });
+        if (written == 1) {
+            this->resident_size.fetch_add(page_size, std::memory_order_relaxed);
+        }
+    }
+}
+
+MemoryBus::OwnedBank MemoryBus::map_bank()
+{
+    // Anonymous mappings read as zero, and the OS only commits the pages written to
+    auto* mapping = mmap(nullptr, BANK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map a memory bank");
+    }
+    return OwnedBank{static_cast<Byte*>(mapping)};
+}
+
+void MemoryBus::BankUnmapper::operator()(Byte* memory) const
+{
+    munmap(memory, BANK_SIZE);
+}
+
+void MemoryBus::unshare(int bank_id)
+{
+    // The shared memory is kept alive, in case another thread is still reading it
+    auto const& shared = *this->shared_banks[bank_id];
+    this->owned_banks[bank_id] = MemoryBus::map_bank();
+    this->memory_banks[bank_id] = this->owned_banks[bank_id].get();
+
+    for (auto& flags : this->page_flags[bank_id]) {
+        flags = (flags & ~PAGE_SHARED) | PAGE_UNTOUCHED;
+    }
+    // Only copy the pages that have data, the others are already zero
+    auto page_size = std::min(host_page_size(), std::size_t{BANK_SIZE});
+    for (auto start = std::size_t{0}; start < BANK_SIZE; start += page_size) {
+        auto first = shared.begin() + start;
+        if (std::any_of(first, first + page_size, [](Byte byte) { return byte != 0; })) {
+            std::memcpy(this->memory_banks[bank_id] + start, shared.data() + start, page_size);
+            this->touch_pages(bank_id, start, start + page_size);
+        }
+    }
+    if (this->remap_handler) {
+        this->remap_handler();
+    }
+}
+
+void MemoryBus::map_device(Device& device, int bank_id, Address start, std::size_t size)
+{
+    auto end = std::size_t{start} + size;
+    for (auto page = std::size_t{start} / PAGE_SIZE; page * PAGE_SIZE < end && page < N_PAGES; ++page) {
+        this->page_flags[bank_id][page] |= PAGE_DEVICE;
+    }
+    this->devices.push_back({&device, bank_id, start, end});
+}
+
+void MemoryBus::track_writes(std::vector<SavedPage>* saved_pages)
+{
+    this->saved_pages = saved_pages;
+    for (auto& bank_flags : this->page_flags) {
+        for (auto& flags : bank_flags) {
+            flags = saved_pages ? (flags | PAGE_UNSAVED) : (flags & ~PAGE_UNSAVED);
+        }
+    }
+}
+
+void MemoryBus::restore(std::vector<SavedPage> const& saved_pages)
+{
+    for (auto&& saved_page : saved_pages) {
+        auto* memory = this->bank(saved_page.bank_id) + saved_page.page * PAGE_SIZE;
+        std::copy(saved_page.data.begin(), saved_page.data.end(), memory);
+        this->touch_pages(saved_page.bank_id, saved_page.page * PAGE_SIZE, (saved_page.page + 1) * PAGE_SIZE);
+    }
+}
+
+void MemoryBus::save_pages(int bank_id, std::size_t start, std::size_t end)
+{
+    for (auto page = start / PAGE_SIZE; page * PAGE_SIZE < end && page < N_PAGES; ++page) {
+        auto& flags = this->page_flags[bank_id][page];
+        if (flags & PAGE_UNSAVED) {
+            flags &= ~PAGE_UNSAVED;
+            auto& saved_page = this->saved_pages->emplace_back(SavedPage{bank_id, int(page), {}});
+            auto const* memory = std::as_const(*this).bank(bank_id) + page * PAGE_SIZE;
+            std::copy(memory, memory + PAGE_SIZE, saved_page.data.begin());
+        }
+    }
+}
+
+void MemoryBus::copy(int dst_bank, Address dst, int src_bank, Address src, std::size_t size)
+{
+    size = std::min({size, BANK_SIZE - std::size_t{dst}, BANK_SIZE - std::size_t{src}});
+    this->save_pages(dst_bank, dst, dst + size);
+    auto* dst_memory = this->bank(dst_bank);
+    std::memmove(dst_memory + dst, std::as_const(*this).bank(src_bank) + src, size);
+    this->touch_pages(dst_bank, dst, dst + size);
+    this->notify_devices(dst_bank, dst, dst + size);
+}
+
+void MemoryBus::fill(int dst_bank, Address dst, Byte value, std::size_t size)
+{
+    size = std::min(size, BANK_SIZE - std::size_t{dst});
+    this->save_pages(dst_bank, dst, dst + size);
+    std::memset(this->bank(dst_bank) + dst, value, size);
+    this->touch_pages(dst_bank, dst, dst + size);
+    this->notify_devices(dst_bank, dst, dst + size);
+}
+
+void MemoryBus::write_block(int dst_bank, Address dst, Byte const* data, std::size_t size)
+{
+    size = std::min(size, BANK_SIZE - std::size_t{dst});
+    this->save_pages(dst_bank, dst, dst + size);
+    std::memcpy(this->bank(dst_bank) + dst, data, size);
+    this->touch_pages(dst_bank, dst, dst + size);
+    this->notify_devices(dst_bank, dst, dst + size);
+}
+
+void MemoryBus::trapped_write(BankView const& bank, Address addr, Byte const* data, int n_bytes)
+{
+    // A word store at 0xffff wraps around to the start of the bank
+    auto end = std::size_t{addr} + n_bytes;
+    this->save_pages(bank.id, addr, std::min(end, std::size_t{BANK_SIZE}));
+    if (end > BANK_SIZE) {
+        this->save_pages(bank.id, 0, end - BANK_SIZE);
+    }
+
+    // Views of a bank that gets unshared are stale, so don't use bank.memory
+    auto* memory = this->bank(bank.id);
+    for (int i = 0; i < n_bytes; ++i) {
+        memory[Address(addr + i)] = data[i];
+    }
+    this->touch_pages(bank.id, addr, std::min(end, std::size_t{BANK_SIZE}));
+    if (end > BANK_SIZE) {
+        this->touch_pages(bank.id, 0, end - BANK_SIZE);
+    }
+
+    if (end > BANK_SIZE) {
+        this->notify_devices(bank.id, addr, BANK_SIZE);
+        this->notify_devices(bank.id, 0, end - BANK_SIZE);
+    } else {
+        this->notify_devices(bank.id, addr, end);
+    }
+}
+
+void MemoryBus::notify_devices(int bank_id, std::size_t start, std::size_t end)
+{
+    for (auto&& range : this->devices) {
+        if (range.bank_id == bank_id && start < range.end && range.start < end) {
+            range.device->on_write(Address(std::max(start, range.start) - range.start));
+        }
+    }
+}
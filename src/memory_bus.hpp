@@ -0,0 +1,159 @@
+#ifndef MICRO16_MEMORY_BUS_HPP
+#define MICRO16_MEMORY_BUS_HPP
+
+#include <specs.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Big endian 16 bit access to raw memory, for devices reading their registers
+inline Register load_word(Byte const* memory)
+{
+    return (memory[0] << 8) + (memory[1] << 0);
+}
+
+inline void store_word(Byte* memory, Register value)
+{
+    memory[0] = (value & 0xff00) >> 8;
+    memory[1] = (value & 0x00ff) >> 0;
+}
+
+class MemoryBus {
+public:
+    class Device {
+    public:
+        // Called right after the CPU stores into a range given to map_device.
+        // `offset` is relative to the start of that range.
+        virtual void on_write(Address offset) = 0;
+    };
+
+    using Bank = std::array<Byte, BANK_SIZE>;
+
+    static constexpr auto PAGE_SIZE = 256;
+    static constexpr auto N_PAGES = BANK_SIZE / PAGE_SIZE;
+
+    // Page flags. Stores into a page with any flag set take the slow path.
+    static constexpr Byte PAGE_DEVICE = 0x01;
+    static constexpr Byte PAGE_SHARED = 0x02;
+    static constexpr Byte PAGE_UNSAVED = 0x04;
+    // Not written since the bank was mapped
+    static constexpr Byte PAGE_UNTOUCHED = 0x08;
+
+    struct SavedPage {
+        int bank_id;
+        int page;
+        std::array<Byte, PAGE_SIZE> data;
+    };
+
+    // A bank as seen by the CPU: its memory and the flags of each of its pages.
+    struct BankView {
+        int id;
+        Byte* memory;
+        Byte const* pages;
+    };
+
+public:
+    MemoryBus();
+
+    BankView view(int bank_id);
+    Byte const* bank(int bank_id) const;
+    // A shared bank is copied before giving write access to it
+    Byte* bank(int bank_id);
+    void map_device(Device& device, int bank_id, Address start, std::size_t size);
+
+    // Maps read-only memory, e.g. the same code for many CPUs, as a bank. It
+    // stays shared until something writes to it: then the bank gets its own
+    // copy, and the remap handler is called so that views can be refreshed.
+    void share(int bank_id, std::shared_ptr<Bank const> memory);
+    bool is_shared(int bank_id) const;
+    void set_remap_handler(std::function<void()> const& handler);
+
+    // Bytes of the banks owned by this bus that are backed by host memory.
+    // Banks are mapped lazily, so this grows with the host pages written to
+    // (pages only read are not committed). Shared banks are not counted.
+    // Can be called from any thread.
+    std::size_t get_resident_size() const;
+    // Writes through bank() aren't seen by get_resident_size: their callers
+    // mark the range here
+    void touch_pages(int bank_id, std::size_t start, std::size_t end);
+
+    // Incremental snapshots. Until the next call, the first write to each page
+    // saves its previous contents into `saved_pages` (nullptr stops it). Only
+    // writes through the bus are seen, not those through bank().
+    void track_writes(std::vector<SavedPage>* saved_pages);
+    // Puts back the pages saved by track_writes
+    void restore(std::vector<SavedPage> const& saved_pages);
+    // Saves the pages of a range that weren't saved yet, e.g. before devices
+    // write to them through bank()
+    void save_pages(int bank_id, std::size_t start, std::size_t end);
+
+    // Bulk transfers for peripherals. Ranges are clamped to the end of the banks.
+    void copy(int dst_bank, Address dst, int src_bank, Address src, std::size_t size);
+    void fill(int dst_bank, Address dst, Byte value, std::size_t size);
+    void write_block(int dst_bank, Address dst, Byte const* data, std::size_t size);
+
+    inline Byte read_byte(BankView const& bank, Address addr) const
+    {
+        return bank.memory[addr];
+    }
+
+    inline Register read_word(BankView const& bank, Address addr) const
+    {
+        return (bank.memory[addr] << 8) + (bank.memory[Address(addr + 1)] << 0);
+    }
+
+    inline void write_byte(BankView const& bank, Address addr, Byte value)
+    {
+        if (bank.pages[addr / PAGE_SIZE] != 0) {
+            this->trapped_write(bank, addr, &value, 1);
+            return;
+        }
+        bank.memory[addr] = value;
+    }
+
+    inline void write_word(BankView const& bank, Address addr, Register value)
+    {
+        Byte data[2] = {Byte((value & 0xff00) >> 8), Byte((value & 0x00ff) >> 0)};
+        if ((bank.pages[addr / PAGE_SIZE] | bank.pages[Address(addr + 1) / PAGE_SIZE]) != 0) {
+            this->trapped_write(bank, addr, data, 2);
+            return;
+        }
+        bank.memory[addr] = data[0];
+        bank.memory[Address(addr + 1)] = data[1];
+    }
+
+private:
+    struct DeviceRange {
+        Device* device;
+        int bank_id;
+        std::size_t start;
+        std::size_t end;
+    };
+
+    struct BankUnmapper {
+        void operator()(Byte* memory) const;
+    };
+    using OwnedBank = std::unique_ptr<Byte, BankUnmapper>;
+
+    static OwnedBank map_bank();
+    void trapped_write(BankView const& bank, Address addr, Byte const* data, int n_bytes);
+    void notify_devices(int bank_id, std::size_t start, std::size_t end);
+    void unshare(int bank_id);
+    // Bytes of the host pages of a bank holding a written page
+    std::size_t touched_size(int bank_id) const;
+
+    std::array<Byte*, N_BANKS> memory_banks;
+    std::array<OwnedBank, N_BANKS> owned_banks;
+    std::array<std::shared_ptr<Bank const>, N_BANKS> shared_banks;
+    std::array<std::array<Byte, N_PAGES>, N_BANKS> page_flags;
+    std::vector<DeviceRange> devices;
+    std::function<void()> remap_handler;
+    std::vector<SavedPage>* saved_pages;
+    // Updated as pages are touched, so other threads don't read the page flags
+    std::atomic<std::size_t> resident_size;
+};
+
+#endif //MICRO16_MEMORY_BUS_HPP
@@ -1,18 +1,59 @@
 #include <micro16.hpp>
-#include <sstream>
+#include <trace_events.hpp>
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace {
+    // CR bit that enables each interrupt, indexed by interrupt id
+    constexpr std::array<Register, 5> INTERRUPT_ENABLE_BITS = {
+        0x0100, // TIE0
+        0x0200, // TIE1
+        0x0020, // IIO1
+        0x0010, // IIO0
+        0x0040, // IIO2
+    };
+
+    // CR bit set by arithmetic instructions on carry, borrow or overflow
+    constexpr Register OV_BIT = 0x0004;
+
+    // The interrupt table, keyboard and device registers, from IT_ADDR. Devices
+    // write there without going through the bus.
+    constexpr auto DEVICE_AREA_END = 0x8000;
+}
 
 Micro16::Micro16(std::array<Byte, BANK_SIZE> const& code)
+        : Micro16(std::make_shared<MemoryBus::Bank const>(code))
+{
+}
+
+Micro16::Micro16(std::shared_ptr<MemoryBus::Bank const> code)
         : running(true)
+        , exit_reason(ExitReason::RUNNING)
         , IP(0x0000)
         , CR(0x9000)
         , SP(0x8000)
         , W({0x0000, 0x0000, 0x0000, 0x0000})
-        , timer_triggered{false}
-        , triggered_timer_id{-1}
-        , timer0{*this, 0}
-        , timer1{*this, 1}
+        , code_bank{bus.view(CODE_BANK)}
+        , mmio_bank{bus.view(MMIO_BANK)}
+        , pending_interrupts{0}
+        , timer_raised_at{}
+        , instruction_count{0}
+        , input_mode{InputMode::LIVE}
+        , recorded_inputs{nullptr}
+        , replayed_inputs{nullptr}
+        , next_replayed_input{0}
+        , recorded_interrupts{0}
+        , halt_requested{false}
+        , has_posted_completions{false}
+        , checkpoint_interval{0}
+        , next_checkpoint_at{0}
+        , max_checkpoints{0}
+        , debugging{false}
 {
-    memory_banks[0] = code;
+    this->bus.set_remap_handler([this]() { this->refresh_bank_views(); });
+    this->bus.share(CODE_BANK, std::move(code));
+    this->write_CR(this->CR);
 }
 
 Micro16::~Micro16()
@@ -23,39 +64,135 @@ Micro16::~Micro16()
 
 void Micro16::run()
 {
-    while (true) {
-        this->check_interrupts();
-        auto instruction = this->instruction_fetch();
-        this->run_instruction(instruction);
-        if (!this->running) {
-            this->disconnect_adapters();
-            break;
+    auto probe = NoProbe{};
+    this->run(probe);
+}
+
+void Micro16::check_interrupts()
+{
+    if (this->has_posted_completions.load(std::memory_order_acquire)) {
+        this->run_posted_completions();
+    }
+    std::scoped_lock _{this->interrupt_mutex};
+    if (this->input_mode != InputMode::LIVE) {
+        this->apply_inputs();
+    }
+    if (this->pending_interrupts != 0 && this->CR & 0x0008) {
+        auto interrupt_id = std::countr_zero(this->pending_interrupts);
+        this->pending_interrupts &= ~(1u << interrupt_id);
+        this->recorded_interrupts &= ~(1u << interrupt_id);
+        auto is_timer = interrupt_id == TIMER0_INTERRUPT || interrupt_id == TIMER1_INTERRUPT;
+        if (is_timer && this->input_mode != InputMode::REPLAY) {
+            this->timer_interrupt_latency.record(std::chrono::steady_clock::now() - this->timer_raised_at[interrupt_id]);
         }
+        TraceEvents::instant("interrupt", "id", interrupt_id);
+
+        this->enter_interrupt_handler(this->bus.read_word(this->mmio_bank, IT_ADDR + IT_ENTRY_SIZE * interrupt_id));
     }
 }
 
-void Micro16::check_interrupts()
+void Micro16::run_posted_completions()
+{
+    auto completions = std::vector<std::function<void()>>{};
+    {
+        std::scoped_lock _{this->interrupt_mutex};
+        std::swap(completions, this->posted_completions);
+        this->has_posted_completions.store(false, std::memory_order_relaxed);
+    }
+    // Without the lock, as completions usually raise interrupts
+    for (auto&& completion : completions) {
+        completion();
+    }
+}
+
+void Micro16::enter_interrupt_handler(Address handler)
+{
+    // Disable global interrupts
+    this->write_CR(this->CR & ~(0x0008));
+
+    // Save current IP on the stack
+    this->SP = this->SP + 2;
+    this->bus.write_word(this->stack_bank, this->SP, this->IP);
+
+    this->IP = handler;
+}
+
+void Micro16::illegal_instruction()
+{
+    // Taken even with interrupts disabled. The saved IP is the one of the
+    // unknown instruction.
+    auto handler = this->bus.read_word(this->mmio_bank, IT_ADDR + IT_ENTRY_SIZE * ILLEGAL_INSTRUCTION_INTERRUPT);
+    if (handler == 0x0000) {
+        this->running = false;
+        this->exit_reason = ExitReason::ILLEGAL_INSTRUCTION;
+        return;
+    }
+    TraceEvents::instant("interrupt", "id", ILLEGAL_INSTRUCTION_INTERRUPT);
+    this->enter_interrupt_handler(handler);
+}
+
+void Micro16::apply_inputs()
 {
-    std::scoped_lock _{this->timer_mutex};
-    if (this->timer_triggered) {
+    auto count = this->instruction_count.load(std::memory_order_relaxed);
+    if (this->input_mode == InputMode::RECORD) {
+        auto& entries = this->recorded_inputs->entries;
+        for (auto event : this->posted_key_events) {
+            if (this->key_event_handler) {
+                this->key_event_handler(event);
+            }
+            entries.push_back({count, InputLog::Type::KEY, event});
+        }
+        this->posted_key_events.clear();
 
-        // Disable global interrupts
-        this->CR &= ~(0x0008);
+        auto new_interrupts = this->pending_interrupts & ~this->recorded_interrupts;
+        if (new_interrupts != 0) {
+            entries.push_back({count, InputLog::Type::INTERRUPTS, Register(new_interrupts)});
+            this->recorded_interrupts |= new_interrupts;
+        }
 
-        // Save current IP on the stack
-        auto stack_bank = (this->CR & 0x3000) >> 12;
-        this->SP = this->SP + 2;
-        this->memory_banks[stack_bank][this->SP] = (this->IP & 0xff00) >> 8;
-        this->memory_banks[stack_bank][this->SP + 1] = (this->IP & 0x00ff) >> 0;
+        // The CPU stops after running the next instruction
+        if (this->halt_requested) {
+            this->halt_requested = false;
+            this->running = false;
+            this->exit_reason = ExitReason::HALT_REQUESTED;
+            entries.push_back({count + 1, InputLog::Type::HALT, 0});
+        }
+        return;
+    }
 
-        // Jump to the address given in the IT
-        auto timer_id = this->triggered_timer_id;
-        auto jmp_addr_raw_ptr = &(this->memory_banks[IT_BANK][IT_ADDR + 4 * timer_id]);
-        auto jmp_addr = (*(jmp_addr_raw_ptr + 0) << 8) + (*(jmp_addr_raw_ptr + 1) << 0);
-        this->IP = jmp_addr;
+    auto& entries = this->replayed_inputs->entries;
+    for (; this->next_replayed_input < entries.size(); ++this->next_replayed_input) {
+        auto const& entry = entries[this->next_replayed_input];
+        if (entry.type == InputLog::Type::HALT ? entry.instruction_count > count + 1 : entry.instruction_count > count) {
+            break;
+        }
+        switch (entry.type) {
+            case InputLog::Type::INTERRUPTS: {
+                this->pending_interrupts |= entry.value;
+                break;
+            }
+            case InputLog::Type::KEY: {
+                if (this->key_event_handler) {
+                    this->key_event_handler(entry.value);
+                }
+                break;
+            }
+            case InputLog::Type::HALT: {
+                this->running = false;
+                this->exit_reason = ExitReason::HALT_REQUESTED;
+                break;
+            }
+        }
+    }
+}
 
-        this->timer_triggered = false;
-        this->triggered_timer_id = -1;
+void Micro16::start_timers()
+{
+    if (!this->timers.empty() || this->get_input_mode() == InputMode::REPLAY) {
+        return;
+    }
+    for (int timer_id = 0; timer_id < 2; ++timer_id) {
+        this->timers.push_back(std::make_unique<TimerInterruptHandler>(*this, timer_id));
     }
 }
 
@@ -68,18 +205,40 @@ void Micro16::disconnect_adapters()
     }
 }
 
-Instruction Micro16::instruction_fetch() const
+void Micro16::write_CR(Register value)
+{
+    this->CR = value;
+    this->data_bank = this->bus.view((this->CR & 0xc000) >> 14);
+    this->stack_bank = this->bus.view((this->CR & 0x3000) >> 12);
+}
+
+void Micro16::set_overflow(bool overflow)
 {
-    auto left = this->memory_banks[CODE_BANK][this->IP];
-    auto right = this->memory_banks[CODE_BANK][this->IP + 1];
+    // The banks don't change, so write_CR isn't needed
+    this->CR = (this->CR & ~OV_BIT) | (overflow ? OV_BIT : 0);
+}
 
-    return (left << 8) + right;
+void Micro16::refresh_bank_views()
+{
+    this->code_bank = this->bus.view(CODE_BANK);
+    this->mmio_bank = this->bus.view(MMIO_BANK);
+    this->write_CR(this->CR);
 }
 
-void Micro16::register_mmio(Adapter& adapter, Address request_addr)
+Instruction Micro16::instruction_fetch() const
 {
-    auto* mem_addr = &this->memory_banks[MMIO_BANK][request_addr];
+    return this->bus.read_word(this->code_bank, this->IP);
+}
+
+void Micro16::register_mmio(Adapter& adapter, Address request_addr, Address watched_size)
+{
+    auto* mem_addr = this->bus.bank(MMIO_BANK) + request_addr;
+    // Devices write their registers without going through the bus
+    this->bus.touch_pages(MMIO_BANK, IT_ADDR, DEVICE_AREA_END);
     adapter.connect_to_memory(mem_addr);
+    if (watched_size > 0) {
+        this->bus.map_device(adapter, MMIO_BANK, request_addr, watched_size);
+    }
     this->adapters.push_back(&adapter);
 }
 
@@ -88,25 +247,293 @@ void Micro16::set_breakpoint_handler(std::function<void()> const& handler)
     this->breakpoint_handler = handler;
 }
 
-Micro16::InternalState Micro16::get_state() const
+void Micro16::set_address_breakpoint_handler(BreakpointHandler const& handler)
 {
-    return {
-        this->running,
-        this->IP,
-        this->CR,
-        this->SP,
-        this->W[0],
-        this->W[1],
-        this->W[2],
-        this->W[3]
-    };
+    this->address_breakpoint_handler = handler;
+}
+
+void Micro16::set_watchpoint_handler(WatchpointHandler const& handler)
+{
+    this->watchpoint_handler = handler;
+}
+
+void Micro16::add_breakpoint(Address addr)
+{
+    if (!this->debug_points) {
+        this->debug_points = std::make_unique<DebugPoints>();
+    }
+    this->debug_points->add_breakpoint(addr);
+    this->update_debugging();
+}
+
+void Micro16::remove_breakpoint(Address addr)
+{
+    if (this->debug_points) {
+        this->debug_points->remove_breakpoint(addr);
+        this->update_debugging();
+    }
+}
+
+void Micro16::add_watchpoint(int bank_id, Address start, std::size_t size, int access)
+{
+    if (!this->debug_points) {
+        this->debug_points = std::make_unique<DebugPoints>();
+    }
+    this->debug_points->add_watchpoint(bank_id, start, size, access);
+    this->update_debugging();
+}
+
+void Micro16::remove_watchpoint(int bank_id, Address start, std::size_t size, int access)
+{
+    if (this->debug_points) {
+        this->debug_points->remove_watchpoint(bank_id, start, size, access);
+        this->update_debugging();
+    }
+}
+
+void Micro16::update_debugging()
+{
+    this->debugging = this->debug_points->is_armed();
 }
 
 void Micro16::force_halt()
 {
+    std::scoped_lock _{this->interrupt_mutex};
+    if (this->input_mode == InputMode::RECORD) {
+        this->halt_requested = true;
+        return;
+    }
     this->running = false;
+    this->exit_reason = ExitReason::HALT_REQUESTED;
+}
+
+Micro16::ExitReason Micro16::get_exit_reason() const
+{
+    return this->exit_reason;
+}
+
+void Micro16::record_inputs(InputLog& log)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    this->input_mode = InputMode::RECORD;
+    this->recorded_inputs = &log;
+    this->recorded_interrupts = this->pending_interrupts;
+}
+
+void Micro16::replay_inputs(InputLog const& log)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    this->input_mode = InputMode::REPLAY;
+    this->replayed_inputs = &log;
+    this->next_replayed_input = 0;
+}
+
+Micro16::InputMode Micro16::get_input_mode() const
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    return this->input_mode;
+}
+
+void Micro16::set_key_event_handler(std::function<void(Register)> const& handler)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    this->key_event_handler = handler;
+}
+
+void Micro16::post_key_event(Register event)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    if (this->input_mode == InputMode::RECORD) {
+        this->posted_key_events.push_back(event);
+    }
+}
+
+void Micro16::post_completion(std::function<void()> const& completion)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    this->posted_completions.push_back(completion);
+    this->has_posted_completions.store(true, std::memory_order_release);
+}
+
+void Micro16::raise_interrupt(int interrupt_id)
+{
+    std::scoped_lock _{this->interrupt_mutex};
+    if (this->CR & INTERRUPT_ENABLE_BITS[interrupt_id]) {
+        auto is_timer = interrupt_id == TIMER0_INTERRUPT || interrupt_id == TIMER1_INTERRUPT;
+        if (is_timer && !(this->pending_interrupts & (1u << interrupt_id))) {
+            this->timer_raised_at[interrupt_id] = std::chrono::steady_clock::now();
+        }
+        this->pending_interrupts |= (1u << interrupt_id);
+    }
+}
+
+MemoryBus& Micro16::get_bus()
+{
+    return this->bus;
+}
+
+MemoryBus const& Micro16::get_bus() const
+{
+    return this->bus;
 }
 
+void Micro16::enable_checkpoints(uint64_t interval, std::size_t capacity)
+{
+    this->checkpoint_interval = std::max(interval, uint64_t{1});
+    this->max_checkpoints = std::max(capacity, std::size_t{1});
+    this->take_checkpoint();
+}
+
+void Micro16::take_checkpoint()
+{
+    auto count = this->instruction_count.load(std::memory_order_relaxed);
+    {
+        std::scoped_lock _{this->interrupt_mutex};
+        auto input_position = std::size_t{0};
+        if (this->input_mode == InputMode::RECORD) {
+            input_position = this->recorded_inputs->entries.size();
+        } else if (this->input_mode == InputMode::REPLAY) {
+            input_position = this->next_replayed_input;
+        }
+        this->checkpoints.push_back({count, this->get_state(), this->exit_reason, this->pending_interrupts, input_position, {}});
+    }
+    this->bus.track_writes(&this->checkpoints.back().saved_pages);
+    this->bus.save_pages(MMIO_BANK, IT_ADDR, DEVICE_AREA_END);
+    if (this->checkpoints.size() > this->max_checkpoints) {
+        this->checkpoints.pop_front();
+    }
+    this->next_checkpoint_at = count + this->checkpoint_interval;
+}
+
+void Micro16::rewind_to(uint64_t instruction_count)
+{
+    auto index = this->checkpoints.size();
+    while (index > 0 && this->checkpoints[index - 1].instruction_count > instruction_count) {
+        --index;
+    }
+    if (index == 0) {
+        throw std::runtime_error("No checkpoint at or before instruction " + std::to_string(instruction_count));
+    }
+
+    // Newest first, so each page ends up as it was on the checkpoint
+    for (auto i = this->checkpoints.size(); i >= index; --i) {
+        this->bus.restore(this->checkpoints[i - 1].saved_pages);
+    }
+    this->checkpoints.resize(index);
+    auto& checkpoint = this->checkpoints.back();
+    checkpoint.saved_pages.clear();
+    this->bus.track_writes(&checkpoint.saved_pages);
+    this->bus.save_pages(MMIO_BANK, IT_ADDR, DEVICE_AREA_END);
+    this->next_checkpoint_at = checkpoint.instruction_count + this->checkpoint_interval;
+
+    auto const& state = checkpoint.state;
+    this->running = state.running;
+    this->exit_reason = checkpoint.exit_reason;
+    this->IP = state.IP;
+    this->SP = state.SP;
+    this->W = {state.W0, state.W1, state.W2, state.W3};
+    this->write_CR(state.CR);
+    this->instruction_count.store(checkpoint.instruction_count, std::memory_order_relaxed);
+
+    // Inputs recorded since the checkpoint are replayed, and recorded again from then on
+    auto was_recording = false;
+    {
+        std::scoped_lock _{this->interrupt_mutex};
+        this->pending_interrupts = checkpoint.pending_interrupts;
+        if (this->input_mode == InputMode::RECORD) {
+            was_recording = true;
+            this->input_mode = InputMode::REPLAY;
+            this->replayed_inputs = this->recorded_inputs;
+        }
+        this->next_replayed_input = checkpoint.input_position;
+    }
+    while (this->running && this->instruction_count.load(std::memory_order_relaxed) < instruction_count) {
+        this->step();
+    }
+    if (was_recording) {
+        std::scoped_lock _{this->interrupt_mutex};
+        this->recorded_inputs->entries.resize(this->next_replayed_input);
+        this->recorded_interrupts = this->pending_interrupts;
+        this->input_mode = InputMode::RECORD;
+    }
+}
+
+std::size_t Micro16::get_checkpoints_size() const
+{
+    auto size = std::size_t{0};
+    for (auto&& checkpoint : this->checkpoints) {
+        size += checkpoint.saved_pages.size() * sizeof(MemoryBus::SavedPage);
+    }
+    return size;
+}
+
+void Micro16::step()
+{
+    this->check_interrupts();
+    this->run_instruction<false>(this->instruction_fetch());
+    this->count_instruction();
+}
+
+uint64_t Micro16::get_instruction_count() const
+{
+    return this->instruction_count.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram const& Micro16::get_timer_interrupt_latency() const
+{
+    return this->timer_interrupt_latency;
+}
+
+void Micro16::check_watchpoint(MemoryBus::BankView const& bank, Address addr, int n_bytes, Register value, DebugPoints::Access type)
+{
+    auto watched = false;
+    for (int i = 0; i < n_bytes; ++i) {
+        watched = watched || this->debug_points->is_watched(bank.id, Address(addr + i), type);
+    }
+    if (watched && this->watchpoint_handler) {
+        this->watchpoint_handler(this->get_state(), this->bus, {bank.id, addr, value, type});
+    }
+}
+
+template <bool DEBUG>
+Register Micro16::read_word(MemoryBus::BankView const& bank, Address addr)
+{
+    auto value = this->bus.read_word(bank, addr);
+    if constexpr (DEBUG) {
+        this->check_watchpoint(bank, addr, 2, value, DebugPoints::READ);
+    }
+    return value;
+}
+
+template <bool DEBUG>
+void Micro16::write_word(MemoryBus::BankView const& bank, Address addr, Register value)
+{
+    this->bus.write_word(bank, addr, value);
+    if constexpr (DEBUG) {
+        this->check_watchpoint(bank, addr, 2, value, DebugPoints::WRITE);
+    }
+}
+
+template <bool DEBUG>
+Byte Micro16::read_byte(MemoryBus::BankView const& bank, Address addr)
+{
+    auto value = this->bus.read_byte(bank, addr);
+    if constexpr (DEBUG) {
+        this->check_watchpoint(bank, addr, 1, value, DebugPoints::READ);
+    }
+    return value;
+}
+
+template <bool DEBUG>
+void Micro16::write_byte(MemoryBus::BankView const& bank, Address addr, Byte value)
+{
+    this->bus.write_byte(bank, addr, value);
+    if constexpr (DEBUG) {
+        this->check_watchpoint(bank, addr, 1, value, DebugPoints::WRITE);
+    }
+}
+
+template <bool DEBUG>
 void Micro16::run_instruction(Instruction const& instruction)
 {
     auto instruction_code = static_cast<Byte>((instruction & 0xff00) >> 8);
@@ -123,7 +550,9 @@ void Micro16::run_instruction(Instruction const& instruction)
             auto bb = (instruction_data & 0b00000011) >> 0;
             auto cc = (instruction_data & 0b00110000) >> 4;
 
-            this->W[cc] = this->W[aa] + this->W[bb];
+            auto result = this->W[aa] + this->W[bb];
+            this->set_overflow(result > 0xffff);
+            this->W[cc] = result;
             break;
         }
         case SUB_CODE: {
@@ -131,7 +560,77 @@ void Micro16::run_instruction(Instruction const& instruction)
             auto bb = (instruction_data & 0b00000011) >> 0;
             auto cc = (instruction_data & 0b00110000) >> 4;
 
-            this->W[cc] = this->W[aa] - this->W[bb];
+            auto result = this->W[aa] - this->W[bb];
+            this->set_overflow(result < 0);
+            this->W[cc] = result;
+            break;
+        }
+        case ADC_CODE: {
+            auto aa = (instruction_data & 0b00001100) >> 2;
+            auto bb = (instruction_data & 0b00000011) >> 0;
+            auto cc = (instruction_data & 0b00110000) >> 4;
+
+            auto result = this->W[aa] + this->W[bb] + ((this->CR & OV_BIT) ? 1 : 0);
+            this->set_overflow(result > 0xffff);
+            this->W[cc] = result;
+            break;
+        }
+        case SBC_CODE: {
+            auto aa = (instruction_data & 0b00001100) >> 2;
+            auto bb = (instruction_data & 0b00000011) >> 0;
+            auto cc = (instruction_data & 0b00110000) >> 4;
+
+            auto result = this->W[aa] - this->W[bb] - ((this->CR & OV_BIT) ? 1 : 0);
+            this->set_overflow(result < 0);
+            this->W[cc] = result;
+            break;
+        }
+        case MUL_CODE: {
+            auto aa = (instruction_data & 0b00001100) >> 2;
+            auto bb = (instruction_data & 0b00000011) >> 0;
+            auto cc = (instruction_data & 0b00110000) >> 4;
+            auto dd = (instruction_data & 0b11000000) >> 6;
+
+            auto result = uint32_t(this->W[aa]) * uint32_t(this->W[bb]);
+            this->set_overflow(result > 0xffff);
+            this->W[cc] = Register(result & 0xffff);
+            this->W[dd] = Register(result >> 16);
+            break;
+        }
+        case DIV_CODE: {
+            auto aa = (instruction_data & 0b00001100) >> 2;
+            auto bb = (instruction_data & 0b00000011) >> 0;
+            auto cc = (instruction_data & 0b00110000) >> 4;
+
+            this->set_overflow(this->W[bb] == 0);
+            this->W[cc] = this->W[bb] == 0 ? 0xffff : this->W[aa] / this->W[bb];
+            break;
+        }
+        case MOD_CODE: {
+            auto aa = (instruction_data & 0b00001100) >> 2;
+            auto bb = (instruction_data & 0b00000011) >> 0;
+            auto cc = (instruction_data & 0b00110000) >> 4;
+
+            this->set_overflow(this->W[bb] == 0);
+            this->W[cc] = this->W[bb] == 0 ? this->W[aa] : this->W[aa] % this->W[bb];
+            break;
+        }
+        case SHL_CODE: {
+            auto aa = (instruction_data & 0b11000000) >> 6;
+            auto ssss = (instruction_data & 0b00001111) >> 0;
+
+            auto result = uint32_t(this->W[aa]) << ssss;
+            this->set_overflow(result & 0x10000);
+            this->W[aa] = Register(result);
+            break;
+        }
+        case SHR_CODE: {
+            auto aa = (instruction_data & 0b11000000) >> 6;
+            auto ssss = (instruction_data & 0b00001111) >> 0;
+
+            // The last bit shifted out
+            this->set_overflow(ssss > 0 && ((this->W[aa] >> (ssss - 1)) & 1));
+            this->W[aa] >>= ssss;
             break;
         }
         case AND_CODE: {
@@ -179,6 +678,14 @@ void Micro16::run_instruction(Instruction const& instruction)
             this->W[aa] |= xxxx << (4 * yy);
             break;
         }
+        case LDI_CODE: {
+            auto aa = (instruction_data & 0b00000011) >> 0;
+
+            this->W[aa] = this->bus.read_word(this->code_bank, Address(this->IP + 2));
+            this->IP += 4;
+            IP_changed = true;
+            break;
+        }
         case CLR_CODE: {
             auto aa = (instruction_data & 0b00000011) >> 0;
 
@@ -191,6 +698,14 @@ void Micro16::run_instruction(Instruction const& instruction)
             this->W[aa] = ~this->W[aa];
             break;
         }
+        case ADDI_CODE: {
+            auto aa = (instruction_data & 0b11000000) >> 6;
+            // Signed, from -32 to 31
+            auto iiiiii = ((instruction_data & 0b00111111) ^ 0b00100000) - 0b00100000;
+
+            this->W[aa] += iiiiii;
+            break;
+        }
         case JMP_CODE: {
             auto aa = (instruction_data & 0b00000011) >> 0;
 
@@ -243,13 +758,11 @@ void Micro16::run_instruction(Instruction const& instruction)
             break;
         }
         case CALL_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
             auto aa = (instruction_data & 0b00000011) >> 0;
 
             this->SP = this->SP + 2;
             auto next_instruction = this->IP + 2;
-            this->memory_banks[stack_bank][this->SP] = (next_instruction & 0xff00) >> 8;
-            this->memory_banks[stack_bank][this->SP + 1] = (next_instruction & 0x00ff) >> 0;
+            this->write_word<DEBUG>(this->stack_bank, this->SP, next_instruction);
             this->IP = this->W[aa];
 
             IP_changed = true;
@@ -266,42 +779,32 @@ void Micro16::run_instruction(Instruction const& instruction)
             break;
         }
         case RET_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
-            auto raw_data_ptr = &(this->memory_banks[stack_bank][this->SP]);
-
-            this->IP = (*(raw_data_ptr + 0) << 8) + (*(raw_data_ptr + 1) << 0);
+            this->IP = this->read_word<DEBUG>(this->stack_bank, this->SP);
             this->SP = this->SP - 2;
 
             IP_changed = true;
             break;
         }
         case RETI_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
-            auto raw_data_ptr = &(this->memory_banks[stack_bank][this->SP]);
-
-            this->IP = (*(raw_data_ptr + 0) << 8) + (*(raw_data_ptr + 1) << 0);
+            this->IP = this->read_word<DEBUG>(this->stack_bank, this->SP);
             this->SP = this->SP - 2;
-            this->CR |= 0x0008;
+            this->write_CR(this->CR | 0x0008);
 
             IP_changed = true;
             break;
         }
         case LD_CODE: {
-            auto selected_bank = (this->CR & 0xc000) >> 14;
             auto aa = (instruction_data & 0b00001100) >> 2;
             auto bb = (instruction_data & 0b00000011) >> 0;
 
-            auto value_ptr = &(this->memory_banks[selected_bank][this->W[aa]]);
-            this->W[bb] = (*(value_ptr + 0) << 8) + (*(value_ptr + 1) << 0);
+            this->W[bb] = this->read_word<DEBUG>(this->data_bank, this->W[aa]);
             break;
         }
         case ST_CODE: {
-            auto selected_bank = (this->CR & 0xc000) >> 14;
             auto aa = (instruction_data & 0b00001100) >> 2;
             auto bb = (instruction_data & 0b00000011) >> 0;
 
-            this->memory_banks[selected_bank][this->W[aa]] = (this->W[bb] & 0xff00) >> 8;
-            this->memory_banks[selected_bank][this->W[aa] + 1] = (this->W[bb] & 0x00ff) >> 0;
+            this->write_word<DEBUG>(this->data_bank, this->W[aa], this->W[bb]);
             break;
         }
         case CPY_CODE: {
@@ -312,30 +815,24 @@ void Micro16::run_instruction(Instruction const& instruction)
             break;
         }
         case PUSH_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
             auto aa = (instruction_data & 0b00000011) >> 0;
 
             this->SP = this->SP + 2;
-            this->memory_banks[stack_bank][this->SP] = (this->W[aa] & 0xff00) >> 8;
-            this->memory_banks[stack_bank][this->SP + 1] = (this->W[aa] & 0x00ff) >> 0;
+            this->write_word<DEBUG>(this->stack_bank, this->SP, this->W[aa]);
             break;
         }
         case POP_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
-            auto raw_data_ptr = &(this->memory_banks[stack_bank][this->SP]);
             auto aa = (instruction_data & 0b00000011) >> 0;
 
-            this->W[aa] = (*(raw_data_ptr + 0) << 8) + (*(raw_data_ptr + 1) << 0);
+            this->W[aa] = this->read_word<DEBUG>(this->stack_bank, this->SP);
             this->SP = this->SP - 2;
             break;
         }
         case PEEK_CODE: {
-            auto stack_bank = (this->CR & 0x3000) >> 12;
-            auto raw_data_ptr = &(this->memory_banks[stack_bank][this->SP]);
             auto aa = (instruction_data & 0b11000000) >> 6;
             auto xx = (instruction_data & 0b00111111) >> 0;
 
-            this->W[aa] = (*(raw_data_ptr - xx) << 8) + (*(raw_data_ptr - xx + 1) << 0);
+            this->W[aa] = this->read_word<DEBUG>(this->stack_bank, this->SP - xx);
             break;
         }
         case CSP_CODE: {
@@ -354,34 +851,46 @@ void Micro16::run_instruction(Instruction const& instruction)
             auto nibble = this->W[aa] & 0xf;
             auto offset = side == 0 ? 4 : 0;
 
-            this->memory_banks[0b01][video_byte] |= (nibble << offset);
+            auto video_data = this->read_byte<DEBUG>(this->mmio_bank, video_byte);
+            this->write_byte<DEBUG>(this->mmio_bank, video_byte, video_data | (nibble << offset));
             break;
         }
         case DAI_CODE: {
-            this->CR &= ~(0x0008);
+            this->write_CR(this->CR & ~(0x0008));
             break;
         }
         case EAI_CODE: {
-            this->CR |= 0x0008;
+            this->write_CR(this->CR | 0x0008);
             break;
         }
         case DTI_CODE: {
             auto a = (instruction_data & 0b00000001) >> 0;
 
-            this->CR &= ~(0x0100 << a);
+            this->write_CR(this->CR & ~(0x0100 << a));
             break;
         }
         case ETI_CODE: {
             auto a = (instruction_data & 0b00000001) >> 0;
 
-            this->CR |= (0x0100 << a);
+            this->write_CR(this->CR | (0x0100 << a));
+            break;
+        }
+        case DII_CODE: {
+            auto aa = (instruction_data & 0b00000011) >> 0;
+
+            this->write_CR(this->CR & ~(0x0010 << aa));
+            break;
+        }
+        case EII_CODE: {
+            auto aa = (instruction_data & 0b00000011) >> 0;
+
+            this->write_CR(this->CR | (0x0010 << aa));
             break;
         }
         case SELB_CODE: {
             auto aa = (instruction_data & 0b00000011) >> 0;
 
-            this->CR &= 0x3fff;
-            this->CR |= (aa << 14);
+            this->write_CR((this->CR & 0x3fff) | (aa << 14));
             break;
         }
         case BRK_CODE: {
@@ -392,13 +901,13 @@ void Micro16::run_instruction(Instruction const& instruction)
         }
         case HLT_CODE: {
             this->running = false;
+            this->exit_reason = ExitReason::HALT;
             break;
         }
         default: {
-            std::stringstream ss;
-            ss << "Unknown instruction code " << std::hex << int(instruction_code) << "\n";
-            ss << "CPU state " << this->get_state() << "\n";
-            throw std::runtime_error(ss.str());
+            this->illegal_instruction();
+            IP_changed = true;
+            break;
         }
     }
 
@@ -414,11 +923,14 @@ void Micro16::run_instruction(Instruction const& instruction)
         this->W[i] &= 0x0000ffff;
     }
     this->IP &= 0x0000ffff;
-    this->CR &= 0x0000ffff;
     this->SP &= 0x0000ffff;
 
 }
 
+// Used by Micro16::run, with and without debug points
+template void Micro16::run_instruction<false>(Instruction const& instruction);
+template void Micro16::run_instruction<true>(Instruction const& instruction);
+
 Micro16::TimerInterruptHandler::TimerInterruptHandler(Micro16& mcu, int timer_id)
     : mcu{mcu}
     , timer_id{timer_id}
@@ -433,22 +945,15 @@ Micro16::TimerInterruptHandler::~TimerInterruptHandler()
 
 void Micro16::TimerInterruptHandler::runner(Micro16::TimerInterruptHandler* self)
 {
+    TraceEvents::set_thread_name("timer" + std::to_string(self->timer_id));
     while (true) {
         auto& mcu = self->mcu;
         auto& timer_id = self->timer_id;
 
+        TraceEvents::instant("timer tick", "id", timer_id);
+        mcu.raise_interrupt(timer_id);
         {
-            std::scoped_lock _{mcu.timer_mutex};
-
-            if (
-                !mcu.timer_triggered &&
-                mcu.CR & 0x0008 &&
-                mcu.CR & (1 << (8 + timer_id))
-            ) {
-                mcu.timer_triggered = true;
-                mcu.triggered_timer_id = self->timer_id;
-            }
-
+            std::scoped_lock _{mcu.interrupt_mutex};
             if (!mcu.running) {
                 return;
             }
@@ -3,13 +3,20 @@
 
 #include <specs.h>
 #include <isa.h>
+#include <memory_bus.hpp>
+#include <debug_points.hpp>
+#include <histogram.hpp>
+#include <input_log.hpp>
 #include <array>
+#include <atomic>
 #include <bitset>
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <deque>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <iomanip>
 
 using namespace std::string_literals;
@@ -17,11 +24,12 @@ using namespace std::chrono_literals;
 
 class Micro16 {
 public:
-    class Adapter {
+    class Adapter : public MemoryBus::Device {
     public:
         virtual void connect_to_memory(Byte* memory_start) = 0;
         virtual bool is_connected() const = 0;
         virtual void disconnect() = 0;
+        void on_write(Address offset) override {}
     };
 
     class TimerInterruptHandler {
@@ -61,42 +69,269 @@ public:
             );
         }
     };
+    struct MemoryAccess {
+        int bank_id;
+        Address addr;
+        Register value;
+        DebugPoints::Access type;
+    };
+    enum class InputMode {
+        LIVE,
+        RECORD,
+        REPLAY,
+    };
+    // Why run() returned
+    enum class ExitReason {
+        RUNNING,
+        // HLT instruction
+        HALT,
+        // force_halt(), e.g. the window was closed
+        HALT_REQUESTED,
+        // Unknown instruction, without a handler in the interrupt table. IP
+        // is left at the instruction.
+        ILLEGAL_INSTRUCTION,
+    };
+
+    using BreakpointHandler = std::function<void(InternalState const& state, MemoryBus const& memory)>;
+    using WatchpointHandler = std::function<void(InternalState const& state, MemoryBus const& memory, MemoryAccess const& access)>;
+
+    // Execution probe that does nothing. Other probes (e.g. ExecutionProfiler)
+    // are selected at compile time through Micro16::run(probe), so there's no
+    // cost in running without one.
+    struct NoProbe {
+        inline void on_instruction(Address IP, Instruction instruction, Address next_IP) {}
+    };
 public:
     Micro16(std::array<Byte, BANK_SIZE> const& code);
+    // Runs code shared with other instances. The code bank is only copied if
+    // the program writes to it.
+    Micro16(std::shared_ptr<MemoryBus::Bank const> code);
     ~Micro16();
 
     void run();
-    void register_mmio(Adapter& adapter, Address request_addr);
+    template <typename Probe>
+    void run(Probe& probe);
+    void register_mmio(Adapter& adapter, Address request_addr, Address watched_size = 0);
     void set_breakpoint_handler(std::function<void()> const& handler);
+
+    // Host side breakpoints and watchpoints, which don't need BRK in the
+    // program. Handlers run on the CPU thread: before the instruction at a
+    // breakpoint, and right after an instruction reads or writes a watched
+    // address. While none is armed, run() uses a loop without these checks.
+    // Change them before run(), or from a handler.
+    void set_address_breakpoint_handler(BreakpointHandler const& handler);
+    void set_watchpoint_handler(WatchpointHandler const& handler);
+    void add_breakpoint(Address addr);
+    void remove_breakpoint(Address addr);
+    // `access` is a combination of DebugPoints::READ and DebugPoints::WRITE
+    void add_watchpoint(int bank_id, Address start, std::size_t size, int access);
+    void remove_watchpoint(int bank_id, Address start, std::size_t size, int access);
     InternalState get_state() const;
+    ExitReason get_exit_reason() const;
     void force_halt();
+    void raise_interrupt(int interrupt_id);
+    MemoryBus& get_bus();
+    MemoryBus const& get_bus() const;
+
+    // Deterministic runs. While recording, every input from another thread
+    // (interrupts, key events and force_halt) is applied between instructions
+    // and appended to `log`, with the instruction count at that point. While
+    // replaying, timers are not started, inputs from other threads (other than
+    // force_halt) are ignored, and those on `log` are applied at the same
+    // counts instead.
+    // Call before run(). `log` must outlive it.
+    void record_inputs(InputLog& log);
+    void replay_inputs(InputLog const& log);
+    InputMode get_input_mode() const;
+
+    // For peripherals writing external inputs into memory (e.g. Keyboard).
+    // Events posted while recording are given to the handler by the CPU
+    // thread, between instructions. They are ignored while replaying.
+    void set_key_event_handler(std::function<void(Register)> const& handler);
+    void post_key_event(Register event);
+
+    // For peripherals doing work on another thread (e.g. Disk), which must
+    // not touch the bus from there. `completion` runs on the CPU thread,
+    // between instructions, before pending interrupts are dispatched.
+    void post_completion(std::function<void()> const& completion);
+
+    // Rewind buffer. A checkpoint is taken now and then every `interval`
+    // instructions, keeping the last `capacity` ones. Each checkpoint only
+    // stores the pages written until the next one. rewind_to() restores the
+    // closest checkpoint at or before `instruction_count`, and runs from it
+    // up to that count. Runs are only reproduced exactly while inputs are
+    // recorded or replayed. Call it while run() isn't running, or from an
+    // address breakpoint handler.
+    void enable_checkpoints(uint64_t interval, std::size_t capacity);
+    void rewind_to(uint64_t instruction_count);
+    // Bytes used by the pages saved on all checkpoints
+    std::size_t get_checkpoints_size() const;
+
+    // Can be read from any thread while the CPU runs
+    uint64_t get_instruction_count() const;
+    // Time from a timer raising its interrupt to it being dispatched
+    LatencyHistogram const& get_timer_interrupt_latency() const;
 
 private:
+    // Runs until the CPU halts (returns true) or debug points are armed or
+    // disarmed (returns false)
+    template <bool DEBUG, typename Probe>
+    bool run_until_debug_change(Probe& probe);
     Instruction instruction_fetch() const;
+    template <bool DEBUG>
     void run_instruction(Instruction const& instruction);
+    template <bool DEBUG>
+    Register read_word(MemoryBus::BankView const& bank, Address addr);
+    template <bool DEBUG>
+    void write_word(MemoryBus::BankView const& bank, Address addr, Register value);
+    template <bool DEBUG>
+    Byte read_byte(MemoryBus::BankView const& bank, Address addr);
+    template <bool DEBUG>
+    void write_byte(MemoryBus::BankView const& bank, Address addr, Byte value);
+    void check_watchpoint(MemoryBus::BankView const& bank, Address addr, int n_bytes, Register value, DebugPoints::Access type);
+    void update_debugging();
+    void count_instruction();
+    void step();
+    void take_checkpoint();
     void check_interrupts();
+    void run_posted_completions();
+    void enter_interrupt_handler(Address handler);
+    void illegal_instruction();
+    void apply_inputs();
+    void start_timers();
     void disconnect_adapters();
+    void write_CR(Register value);
+    void set_overflow(bool overflow);
+    void refresh_bank_views();
 
 private:
     bool running;
+    ExitReason exit_reason;
 
     Register IP;
     Register CR;
     Register SP;
     std::array<Register, 4> W;
 
-    std::array<std::array<Byte, BANK_SIZE>, N_BANKS> memory_banks;
+    MemoryBus bus;
+    MemoryBus::BankView code_bank;
+    MemoryBus::BankView mmio_bank;
+
+    // Banks currently selected by the BK and SB bits of CR. They are only
+    // updated by write_CR, so memory instructions don't need to decode CR.
+    MemoryBus::BankView data_bank;
+    MemoryBus::BankView stack_bank;
+
+    mutable std::mutex interrupt_mutex;
+    unsigned int pending_interrupts;
+    std::array<std::chrono::steady_clock::time_point, 2> timer_raised_at;
+    LatencyHistogram timer_interrupt_latency;
 
-    std::mutex timer_mutex;
-    bool timer_triggered;
-    int triggered_timer_id;
-    TimerInterruptHandler timer0;
-    TimerInterruptHandler timer1;
+    // Only written by the CPU thread
+    std::atomic<uint64_t> instruction_count;
+    std::vector<std::unique_ptr<TimerInterruptHandler>> timers;
+
+    // Guarded by interrupt_mutex
+    InputMode input_mode;
+    InputLog* recorded_inputs;
+    InputLog const* replayed_inputs;
+    std::size_t next_replayed_input;
+    unsigned int recorded_interrupts;
+    bool halt_requested;
+    std::vector<Register> posted_key_events;
+    std::function<void(Register)> key_event_handler;
+    std::vector<std::function<void()>> posted_completions;
+    // Set while posted_completions isn't empty, so the CPU doesn't need the lock to check it
+    std::atomic<bool> has_posted_completions;
 
     std::vector<Adapter*> adapters;
     std::function<void()> breakpoint_handler;
+
+    struct Checkpoint {
+        uint64_t instruction_count;
+        InternalState state;
+        ExitReason exit_reason;
+        unsigned int pending_interrupts;
+        // Next entry of the recorded or replayed inputs
+        std::size_t input_position;
+        // Contents before the first write after this checkpoint
+        std::vector<MemoryBus::SavedPage> saved_pages;
+    };
+    std::deque<Checkpoint> checkpoints;
+    uint64_t checkpoint_interval;
+    uint64_t next_checkpoint_at;
+    std::size_t max_checkpoints;
+
+    // Only allocated once a debug point is added
+    std::unique_ptr<DebugPoints> debug_points;
+    bool debugging;
+    BreakpointHandler address_breakpoint_handler;
+    WatchpointHandler watchpoint_handler;
 };
 
+inline Micro16::InternalState Micro16::get_state() const
+{
+    return {
+        this->running,
+        this->IP,
+        this->CR,
+        this->SP,
+        this->W[0],
+        this->W[1],
+        this->W[2],
+        this->W[3]
+    };
+}
+
+template <typename Probe>
+void Micro16::run(Probe& probe)
+{
+    this->start_timers();
+    while (true) {
+        auto halted = this->debugging ? this->run_until_debug_change<true>(probe) : this->run_until_debug_change<false>(probe);
+        if (halted) {
+            this->disconnect_adapters();
+            break;
+        }
+    }
+}
+
+template <bool DEBUG, typename Probe>
+bool Micro16::run_until_debug_change(Probe& probe)
+{
+    while (true) {
+        this->check_interrupts();
+        auto IP = this->IP;
+        if constexpr (DEBUG) {
+            if (this->debug_points->has_breakpoint(IP) && this->address_breakpoint_handler) {
+                this->address_breakpoint_handler(this->get_state(), this->bus);
+                if (!this->running) {
+                    return true;
+                }
+            }
+        }
+        auto instruction = this->instruction_fetch();
+        this->run_instruction<DEBUG>(instruction);
+        this->count_instruction();
+        probe.on_instruction(IP, instruction, this->IP);
+        if (!this->running) {
+            return true;
+        }
+        if (this->debugging != DEBUG) {
+            return false;
+        }
+    }
+}
+
+inline void Micro16::count_instruction()
+{
+    auto count = this->instruction_count.load(std::memory_order_relaxed) + 1;
+    this->instruction_count.store(count, std::memory_order_relaxed);
+    if (count == this->next_checkpoint_at) {
+        this->take_checkpoint();
+    }
+}
+
 inline std::ostream& operator<<(std::ostream& os, Micro16::InternalState const& state)
 {
     os << "{\n"s;
@@ -0,0 +1,120 @@
+#include <profiler.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    struct BasicBlock {
+        Address start;
+        Address end;
+        uint64_t executions;
+        uint64_t instructions;
+    };
+
+    bool is_branch(Byte const* code, Address addr)
+    {
+        return (code[addr] & 0xc0) == 0x80;
+    }
+
+    Address next_instruction(Byte const* code, Address addr)
+    {
+        return Address(addr + (code[addr] == LDI_CODE ? 4 : 2));
+    }
+
+    std::string hex_address(Address addr)
+    {
+        std::stringstream ss;
+        ss << "0x" << std::setw(4) << std::setfill('0') << std::hex << addr;
+        return ss.str();
+    }
+}
+
+ExecutionProfiler::ExecutionProfiler()
+    : executions(N_COUNTERS, 0)
+    , taken_branches(N_COUNTERS, 0)
+{
+}
+
+uint64_t ExecutionProfiler::get_executions(Address IP) const
+{
+    return this->executions[IP / 2];
+}
+
+uint64_t ExecutionProfiler::get_taken_branches(Address IP) const
+{
+    return this->taken_branches[IP / 2];
+}
+
+void ExecutionProfiler::write_report(
+    std::ostream& os,
+    Byte const* code,
+    Symbolizer const& symbolize,
+    std::size_t n_entries
+) const
+{
+    auto source_of = [&symbolize](Address addr) {
+        return symbolize ? symbolize(addr) : std::string{};
+    };
+
+    auto total = uint64_t{0};
+    auto hot_addresses = std::vector<Address>{};
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        if (this->executions[i] != 0) {
+            total += this->executions[i];
+            hot_addresses.push_back(2 * i);
+        }
+    }
+    std::stable_sort(hot_addresses.begin(), hot_addresses.end(), [this](Address a, Address b) {
+        return this->executions[a / 2] > this->executions[b / 2];
+    });
+    hot_addresses.resize(std::min(hot_addresses.size(), n_entries));
+
+    // A block goes on while the same count of instructions is executed, and
+    // ends on branch instructions.
+    auto blocks = std::vector<BasicBlock>{};
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        auto count = this->executions[i];
+        if (count == 0) {
+            continue;
+        }
+        auto addr = Address(2 * i);
+        auto continues_block = (
+            !blocks.empty() &&
+            next_instruction(code, blocks.back().end) == addr &&
+            blocks.back().executions == count &&
+            !is_branch(code, blocks.back().end)
+        );
+        if (continues_block) {
+            blocks.back().end = addr;
+            blocks.back().instructions += count;
+        } else {
+            blocks.push_back({addr, addr, count, count});
+        }
+    }
+    std::stable_sort(blocks.begin(), blocks.end(), [](BasicBlock const& a, BasicBlock const& b) {
+        return a.instructions > b.instructions;
+    });
+    blocks.resize(std::min(blocks.size(), n_entries));
+
+    os << "Executed instructions: " << total << "\n";
+    os << "\n";
+    os << "Hot addresses:\n";
+    os << std::left << std::setw(10) << "address" << std::setw(16) << "executions" << std::setw(10) << "%";
+    os << std::setw(16) << "taken branches" << "source" << "\n";
+    for (auto addr : hot_addresses) {
+        auto count = this->executions[addr / 2];
+        os << std::setw(10) << hex_address(addr) << std::setw(16) << count;
+        os << std::setw(10) << std::fixed << std::setprecision(2) << (100.0 * count / total);
+        os << std::setw(16) << this->taken_branches[addr / 2] << source_of(addr) << "\n";
+    }
+    os << "\n";
+    os << "Hot basic blocks:\n";
+    os << std::setw(18) << "addresses" << std::setw(16) << "executions" << std::setw(16) << "instructions";
+    os << std::setw(10) << "%" << "source" << "\n";
+    for (auto&& block : blocks) {
+        os << std::setw(18) << (hex_address(block.start) + "-" + hex_address(block.end));
+        os << std::setw(16) << block.executions << std::setw(16) << block.instructions;
+        os << std::setw(10) << std::fixed << std::setprecision(2) << (100.0 * block.instructions / total);
+        os << source_of(block.start) << "\n";
+    }
+}
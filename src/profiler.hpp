@@ -0,0 +1,50 @@
+#ifndef MICRO16_PROFILER_HPP
+#define MICRO16_PROFILER_HPP
+
+#include <micro16.hpp>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counts how many times each instruction was executed, and how many times it
+// branched (IP was not just advanced to the next instruction).
+// Use it as a probe on Micro16::run(profiler).
+class ExecutionProfiler {
+public:
+    // One counter per instruction address on the code bank
+    static constexpr auto N_COUNTERS = BANK_SIZE / 2;
+
+    // Source location of an address, e.g. "file.m16asm:12". Empty if unknown.
+    using Symbolizer = std::function<std::string(Address)>;
+
+    ExecutionProfiler();
+
+    inline void on_instruction(Address IP, Instruction instruction, Address next_IP)
+    {
+        auto i = IP / 2;
+        this->executions[i] += 1;
+        auto size = (instruction >> 8) == LDI_CODE ? 4 : 2;
+        if (next_IP != Address(IP + size)) {
+            this->taken_branches[i] += 1;
+        }
+    }
+
+    uint64_t get_executions(Address IP) const;
+    uint64_t get_taken_branches(Address IP) const;
+
+    // Writes the `n_entries` hottest addresses and basic blocks. `code` is the
+    // code bank, used to find where basic blocks end.
+    void write_report(
+        std::ostream& os,
+        Byte const* code,
+        Symbolizer const& symbolize = {},
+        std::size_t n_entries = 20
+    ) const;
+
+private:
+    std::vector<uint64_t> executions;
+    std::vector<uint64_t> taken_branches;
+};
+
+#endif //MICRO16_PROFILER_HPP
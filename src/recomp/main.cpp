@@ -0,0 +1,39 @@
+#include <recomp/recompiler.hpp>
+#include <reader.hpp>
+#include <argparse.hpp>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    argparse::ArgumentParser arg_parser("micro16_recomp");
+    arg_parser.add_argument("input_file")
+        .help("Micro16 binary (.micro16)");
+    arg_parser.add_argument("output_file")
+        .help("Output C++ file");
+    arg_parser.add_argument("--no-main")
+        .help("Don't generate main(), only load_recompiled_code() and run_recompiled()")
+        .default_value(false)
+        .implicit_value(true);
+
+    try {
+        arg_parser.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << arg_parser;
+        return -1;
+    }
+
+    try {
+        auto code = read_code_from_file(arg_parser.get<std::string>("input_file"));
+        auto recompiler = Recompiler{code};
+        auto out_stream = std::ofstream{arg_parser.get<std::string>("output_file"), std::ios::out};
+        recompiler.write_cpp(out_stream, !arg_parser.get<bool>("--no-main"));
+        std::cout << "Recompiled " << recompiler.get_blocks().size() << " basic blocks.\n";
+    } catch (std::runtime_error const& err) {
+        std::cerr << err.what() << "\n";
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,442 @@
+#include <recomp/recompiler.hpp>
+#include <isa.h>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <string>
+
+namespace {
+    // How the operands are packed on the low byte of each instruction
+    enum class Fields {
+        NONE,
+        A,      // 0000 00aa
+        AB,     // 0000 aabb
+        ABC,    // 00cc aabb
+        ABC_X,  // xxcc aabb
+        SET,    // aayy xxxx
+        BRNZ,   // 0000 ccaa
+        A_X4,   // aa00 xxxx
+        A_X6,   // aaxx xxxx
+        X1,     // 0000 000x
+        X2,     // 0000 00xx
+    };
+
+    // What may run after an instruction
+    enum class Flow {
+        NEXT,
+        BRANCH, // To W[c], or to the next instruction
+        JUMP,   // To W[a]
+        CALL,   // To W[a], and later back to the next instruction
+        RETURN, // To an address taken from the stack
+        HALT,
+    };
+
+    // `cpp` is the body of the instruction, operating on `s`. Placeholders:
+    // {a}, {b}, {c} (registers), {x}, {y} (immediates), {imm} (the word after
+    // LDI) and {next} (address of the next instruction). Instructions that
+    // change IP return right away.
+    struct OpcodeInfo {
+        Byte code;
+        Fields fields;
+        Flow flow;
+        char const* cpp;
+    };
+
+    constexpr OpcodeInfo OPCODES[] = {
+        {NOP_CODE,  Fields::NONE, Flow::NEXT,   ""},
+        {ADD_CODE,  Fields::ABC,  Flow::NEXT,   "{ auto r = s.W[{a}] + s.W[{b}]; s.set_overflow(r > 0xffff); s.W[{c}] = r; }"},
+        {SUB_CODE,  Fields::ABC,  Flow::NEXT,   "{ auto r = s.W[{a}] - s.W[{b}]; s.set_overflow(r < 0); s.W[{c}] = r; }"},
+        {AND_CODE,  Fields::ABC,  Flow::NEXT,   "s.W[{c}] = s.W[{a}] & s.W[{b}];"},
+        {OR_CODE,   Fields::ABC,  Flow::NEXT,   "s.W[{c}] = s.W[{a}] | s.W[{b}];"},
+        {XOR_CODE,  Fields::ABC,  Flow::NEXT,   "s.W[{c}] = s.W[{a}] ^ s.W[{b}];"},
+        {INC_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] += 1;"},
+        {DEC_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] -= 1;"},
+        {SET_CODE,  Fields::SET,  Flow::NEXT,   "s.W[{a}] = (s.W[{a}] & ~(0x000f << (4 * {y}))) | ({x} << (4 * {y}));"},
+        {LDI_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] = {imm};"},
+        {CLR_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] = 0;"},
+        {NOT_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] = ~s.W[{a}];"},
+        {ADDI_CODE, Fields::A_X6, Flow::NEXT,   "s.W[{a}] += ({x} ^ 0x20) - 0x20;"},
+        {SHL_CODE,  Fields::A_X4, Flow::NEXT,   "{ auto r = uint32_t(s.W[{a}]) << {x}; s.set_overflow(r & 0x10000); s.W[{a}] = r; }"},
+        {SHR_CODE,  Fields::A_X4, Flow::NEXT,   "s.set_overflow({x} > 0 && ((s.W[{a}] >> ({x} - 1)) & 1)); s.W[{a}] >>= {x};"},
+        {MUL_CODE,  Fields::ABC_X, Flow::NEXT,  "{ auto r = uint32_t(s.W[{a}]) * s.W[{b}]; s.set_overflow(r > 0xffff); s.W[{c}] = r; s.W[{x}] = r >> 16; }"},
+        {DIV_CODE,  Fields::ABC,  Flow::NEXT,   "s.set_overflow(s.W[{b}] == 0); s.W[{c}] = s.W[{b}] == 0 ? 0xffff : s.W[{a}] / s.W[{b}];"},
+        {MOD_CODE,  Fields::ABC,  Flow::NEXT,   "s.set_overflow(s.W[{b}] == 0); s.W[{c}] = s.W[{b}] == 0 ? s.W[{a}] : s.W[{a}] % s.W[{b}];"},
+        {ADC_CODE,  Fields::ABC,  Flow::NEXT,   "{ auto r = s.W[{a}] + s.W[{b}] + s.overflow(); s.set_overflow(r > 0xffff); s.W[{c}] = r; }"},
+        {SBC_CODE,  Fields::ABC,  Flow::NEXT,   "{ auto r = s.W[{a}] - s.W[{b}] - s.overflow(); s.set_overflow(r < 0); s.W[{c}] = r; }"},
+        {JMP_CODE,  Fields::A,    Flow::JUMP,   "s.IP = s.W[{a}]; return;"},
+        {BRE_CODE,  Fields::ABC,  Flow::BRANCH, "if (s.W[{a}] == s.W[{b}]) { s.IP = s.W[{c}]; return; }"},
+        {BRNE_CODE, Fields::ABC,  Flow::BRANCH, "if (s.W[{a}] != s.W[{b}]) { s.IP = s.W[{c}]; return; }"},
+        {BRL_CODE,  Fields::ABC,  Flow::BRANCH, "if (s.W[{a}] < s.W[{b}]) { s.IP = s.W[{c}]; return; }"},
+        {BRH_CODE,  Fields::ABC,  Flow::BRANCH, "if (s.W[{a}] > s.W[{b}]) { s.IP = s.W[{c}]; return; }"},
+        {CALL_CODE, Fields::A,    Flow::CALL,   "s.SP += 2; s.write_word(s.stack_bank(), s.SP, {next}); s.IP = s.W[{a}]; return;"},
+        {RET_CODE,  Fields::NONE, Flow::RETURN, "s.IP = s.read_word(s.stack_bank(), s.SP); s.SP -= 2; return;"},
+        {RETI_CODE, Fields::NONE, Flow::RETURN, "s.IP = s.read_word(s.stack_bank(), s.SP); s.SP -= 2; s.CR |= 0x0008; return;"},
+        {BRNZ_CODE, Fields::BRNZ, Flow::BRANCH, "if (s.W[{a}] != 0) { s.IP = s.W[{c}]; return; }"},
+        {LD_CODE,   Fields::AB,   Flow::NEXT,   "s.W[{b}] = s.read_word(s.data_bank(), s.W[{a}]);"},
+        {ST_CODE,   Fields::AB,   Flow::NEXT,   "s.write_word(s.data_bank(), s.W[{a}], s.W[{b}]);"},
+        {CPY_CODE,  Fields::AB,   Flow::NEXT,   "s.W[{b}] = s.W[{a}];"},
+        {PUSH_CODE, Fields::A,    Flow::NEXT,   "s.SP += 2; s.write_word(s.stack_bank(), s.SP, s.W[{a}]);"},
+        {POP_CODE,  Fields::A,    Flow::NEXT,   "s.W[{a}] = s.read_word(s.stack_bank(), s.SP); s.SP -= 2;"},
+        {PEEK_CODE, Fields::A_X6, Flow::NEXT,   "s.W[{a}] = s.read_word(s.stack_bank(), Address(s.SP - {x}));"},
+        {CSP_CODE,  Fields::A_X6, Flow::NEXT,   "s.W[{a}] = s.SP - {x};"},
+        {SPXL_CODE, Fields::AB,   Flow::NEXT,   "s.set_pixel(s.W[{a}], s.W[{b}]);"},
+        {DAI_CODE,  Fields::NONE, Flow::NEXT,   "s.CR &= ~0x0008;"},
+        {EAI_CODE,  Fields::NONE, Flow::NEXT,   "s.CR |= 0x0008;"},
+        {DTI_CODE,  Fields::X1,   Flow::NEXT,   "s.CR &= ~(0x0100 << {x});"},
+        {ETI_CODE,  Fields::X1,   Flow::NEXT,   "s.CR |= (0x0100 << {x});"},
+        {SELB_CODE, Fields::X2,   Flow::NEXT,   "s.CR = (s.CR & 0x3fff) | ({x} << 14);"},
+        {DII_CODE,  Fields::X2,   Flow::NEXT,   "s.CR &= ~(0x0010 << {x});"},
+        {EII_CODE,  Fields::X2,   Flow::NEXT,   "s.CR |= (0x0010 << {x});"},
+        {BRK_CODE,  Fields::NONE, Flow::NEXT,   ""},
+        {HLT_CODE,  Fields::NONE, Flow::HALT,   "s.running = false; s.IP = {next}; return;"},
+    };
+
+    std::optional<OpcodeInfo> opcode_info(Instruction instruction)
+    {
+        for (auto&& info : OPCODES) {
+            if (info.code == (instruction >> 8)) {
+                return info;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Instructions are one word, except LDI which is followed by its value
+    int instruction_size(OpcodeInfo const& info)
+    {
+        return info.code == LDI_CODE ? 4 : 2;
+    }
+
+    struct Operands {
+        int a;
+        int b;
+        int c;
+        int x;
+        int y;
+    };
+
+    Operands decode(Fields fields, Byte d)
+    {
+        switch (fields) {
+            case Fields::A: return {d & 3, 0, 0, 0, 0};
+            case Fields::AB: return {(d >> 2) & 3, d & 3, 0, 0, 0};
+            case Fields::ABC: return {(d >> 2) & 3, d & 3, (d >> 4) & 3, 0, 0};
+            case Fields::ABC_X: return {(d >> 2) & 3, d & 3, (d >> 4) & 3, (d >> 6) & 3, 0};
+            case Fields::SET: return {(d >> 6) & 3, 0, 0, d & 0xf, (d >> 4) & 3};
+            case Fields::BRNZ: return {d & 3, 0, (d >> 2) & 3, 0, 0};
+            case Fields::A_X4: return {(d >> 6) & 3, 0, 0, d & 0xf, 0};
+            case Fields::A_X6: return {(d >> 6) & 3, 0, 0, d & 0x3f, 0};
+            case Fields::X1: return {0, 0, 0, d & 1, 0};
+            case Fields::X2: return {0, 0, 0, d & 3, 0};
+            default: return {0, 0, 0, 0, 0};
+        }
+    }
+
+    // Same as `decode`, as C++ run by the generated interpreter on `d`
+    char const* decode_cpp(Fields fields)
+    {
+        switch (fields) {
+            case Fields::A: return "auto a = d & 3; ";
+            case Fields::AB: return "auto a = (d >> 2) & 3; auto b = d & 3; ";
+            case Fields::ABC: return "auto a = (d >> 2) & 3; auto b = d & 3; auto c = (d >> 4) & 3; ";
+            case Fields::ABC_X: return "auto a = (d >> 2) & 3; auto b = d & 3; auto c = (d >> 4) & 3; auto x = (d >> 6) & 3; ";
+            case Fields::SET: return "auto a = (d >> 6) & 3; auto y = (d >> 4) & 3; auto x = d & 0xf; ";
+            case Fields::BRNZ: return "auto a = d & 3; auto c = (d >> 2) & 3; ";
+            case Fields::A_X4: return "auto a = (d >> 6) & 3; auto x = d & 0xf; ";
+            case Fields::A_X6: return "auto a = (d >> 6) & 3; auto x = d & 0x3f; ";
+            case Fields::X1: return "auto x = d & 1; ";
+            case Fields::X2: return "auto x = d & 3; ";
+            default: return "";
+        }
+    }
+
+    std::string hex(int value, int width = 4)
+    {
+        std::stringstream ss;
+        ss << "0x" << std::setw(width) << std::setfill('0') << std::hex << value;
+        return ss.str();
+    }
+
+    std::string substitute(std::string cpp, std::string const& placeholder, std::string const& value)
+    {
+        for (auto pos = cpp.find(placeholder); pos != std::string::npos; pos = cpp.find(placeholder, pos)) {
+            cpp.replace(pos, placeholder.size(), value);
+            pos += value.size();
+        }
+        return cpp;
+    }
+
+    std::string instruction_cpp(OpcodeInfo const& info, Operands const& ops, std::string const& imm, std::string const& next)
+    {
+        auto cpp = std::string{info.cpp};
+        cpp = substitute(cpp, "{imm}", imm);
+        cpp = substitute(cpp, "{a}", std::to_string(ops.a));
+        cpp = substitute(cpp, "{b}", std::to_string(ops.b));
+        cpp = substitute(cpp, "{c}", std::to_string(ops.c));
+        cpp = substitute(cpp, "{x}", std::to_string(ops.x));
+        cpp = substitute(cpp, "{y}", std::to_string(ops.y));
+        return substitute(cpp, "{next}", next);
+    }
+
+    // Bits of a register known at recompile time
+    struct KnownValue {
+        Register value;
+        Register mask;
+
+        bool is_constant() const
+        {
+            return this->mask == 0xffff;
+        }
+    };
+}
+
+Recompiler::Recompiler(std::array<Byte, BANK_SIZE> const& code)
+    : code(code)
+    , code_size(0)
+{
+    for (auto i = std::size_t{0}; i < BANK_SIZE; ++i) {
+        if (code[i] != 0) {
+            this->code_size = i + 1;
+        }
+    }
+    this->discover_leaders();
+    this->build_blocks();
+}
+
+std::vector<Recompiler::BasicBlock> const& Recompiler::get_blocks() const
+{
+    return this->blocks;
+}
+
+Instruction Recompiler::instruction_at(Address addr) const
+{
+    return (this->code[addr] << 8) + (this->code[Address(addr + 1)] << 0);
+}
+
+void Recompiler::discover_leaders()
+{
+    auto pending = std::vector<Address>{0x0000};
+    auto add_leader = [this, &pending](std::size_t addr) {
+        if (addr % 2 == 0 && addr < this->code_size && this->leaders.insert(Address(addr)).second) {
+            pending.push_back(Address(addr));
+        }
+    };
+    this->leaders.insert(0x0000);
+
+    while (!pending.empty()) {
+        // Not an Address, which would wrap around at the end of a full bank
+        auto addr = std::size_t{pending.back()};
+        pending.pop_back();
+        auto info = std::optional<OpcodeInfo>{};
+
+        // Follow the constants loaded into registers, to find branch targets
+        auto known = std::array<KnownValue, 4>{};
+        auto set_known = [&known, &add_leader](int reg, Register value, Register mask) {
+            known[reg] = {value, mask};
+            if (known[reg].is_constant()) {
+                add_leader(value);
+            }
+        };
+        auto known_target = [&known, &add_leader](int reg) {
+            if (known[reg].is_constant()) {
+                add_leader(known[reg].value);
+            }
+        };
+
+        for (; addr < this->code_size; addr += instruction_size(*info)) {
+            auto instruction = this->instruction_at(Address(addr));
+            info = opcode_info(instruction);
+            if (!info) {
+                break;
+            }
+            auto ops = decode(info->fields, instruction & 0xff);
+            auto const& a = known[ops.a];
+            auto const& b = known[ops.b];
+            auto both_constant = a.is_constant() && b.is_constant();
+            switch (info->code) {
+                case SET_CODE: {
+                    auto nibble_mask = Register(0x000f << (4 * ops.y));
+                    set_known(ops.a, (a.value & ~nibble_mask) | (ops.x << (4 * ops.y)), a.mask | nibble_mask);
+                    break;
+                }
+                case LDI_CODE: set_known(ops.a, this->instruction_at(Address(addr + 2)), 0xffff); break;
+                case CLR_CODE: set_known(ops.a, 0, 0xffff); break;
+                case CPY_CODE: set_known(ops.b, a.value, a.mask); break;
+                case INC_CODE: set_known(ops.a, a.value + 1, a.is_constant() ? 0xffff : 0); break;
+                case DEC_CODE: set_known(ops.a, a.value - 1, a.is_constant() ? 0xffff : 0); break;
+                case NOT_CODE: set_known(ops.a, ~a.value, a.mask); break;
+                case ADDI_CODE: set_known(ops.a, a.value + ((ops.x ^ 0x20) - 0x20), a.is_constant() ? 0xffff : 0); break;
+                case SHL_CODE: set_known(ops.a, a.value << ops.x, Register(a.mask << ops.x) | ((1 << ops.x) - 1)); break;
+                case SHR_CODE: set_known(ops.a, a.value >> ops.x, Register(a.mask >> ops.x) | ~(0xffff >> ops.x)); break;
+                case ADD_CODE: set_known(ops.c, a.value + b.value, both_constant ? 0xffff : 0); break;
+                case SUB_CODE: set_known(ops.c, a.value - b.value, both_constant ? 0xffff : 0); break;
+                case AND_CODE: set_known(ops.c, a.value & b.value, both_constant ? 0xffff : 0); break;
+                case OR_CODE: set_known(ops.c, a.value | b.value, both_constant ? 0xffff : 0); break;
+                case XOR_CODE: set_known(ops.c, a.value ^ b.value, both_constant ? 0xffff : 0); break;
+                case MUL_CODE: known[ops.c] = {0, 0}; known[ops.x] = {0, 0}; break;
+                case DIV_CODE: known[ops.c] = {0, 0}; break;
+                case MOD_CODE: known[ops.c] = {0, 0}; break;
+                case ADC_CODE: known[ops.c] = {0, 0}; break;
+                case SBC_CODE: known[ops.c] = {0, 0}; break;
+                case LD_CODE: known[ops.b] = {0, 0}; break;
+                case POP_CODE: known[ops.a] = {0, 0}; break;
+                case PEEK_CODE: known[ops.a] = {0, 0}; break;
+                case CSP_CODE: known[ops.a] = {0, 0}; break;
+            }
+
+            if (info->flow == Flow::NEXT) {
+                continue;
+            }
+            if (info->flow == Flow::BRANCH) {
+                known_target(ops.c);
+            } else if (info->flow == Flow::JUMP || info->flow == Flow::CALL) {
+                known_target(ops.a);
+            }
+            if (info->flow == Flow::BRANCH || info->flow == Flow::CALL) {
+                add_leader(addr + instruction_size(*info));
+            }
+            break;
+        }
+    }
+}
+
+void Recompiler::build_blocks()
+{
+    for (auto leader : this->leaders) {
+        if (!opcode_info(this->instruction_at(leader))) {
+            continue;
+        }
+        auto end = leader;
+        while (true) {
+            auto info = opcode_info(this->instruction_at(end));
+            auto next = std::size_t{end} + instruction_size(*info);
+            auto ends_block = (
+                info->flow != Flow::NEXT ||
+                next >= this->code_size ||
+                this->leaders.contains(Address(next)) ||
+                !opcode_info(this->instruction_at(Address(next)))
+            );
+            if (ends_block) {
+                break;
+            }
+            end = Address(next);
+        }
+        this->blocks.push_back({leader, end});
+    }
+}
+
+void Recompiler::write_cpp(std::ostream& os, bool with_main) const
+{
+    os << "// Generated by micro16_recomp.\n";
+    os << "// Build with: c++ -std=c++20 -O2 -I <micro16>/src <this file>\n";
+    os << "#include <recomp/runtime.hpp>\n";
+    os << "#include <algorithm>\n";
+    os << "#include <iomanip>\n";
+    os << "#include <iostream>\n";
+    os << "#include <memory>\n";
+    os << "#include <string>\n";
+    os << "\n";
+    os << "namespace {\n";
+
+    os << "    constexpr Byte CODE[] = {";
+    for (auto i = std::size_t{0}; i < std::max(this->code_size, std::size_t{1}); ++i) {
+        os << (i % 16 == 0 ? "\n        " : " ") << hex(this->code[i], 2) << ",";
+    }
+    os << "\n    };\n\n";
+
+    os << "    // Runs a single instruction, for addresses not starting a recompiled block\n";
+    os << "    void step(Micro16State& s)\n";
+    os << "    {\n";
+    os << "        auto instruction = s.read_word(s.banks[CODE_BANK].data(), s.IP);\n";
+    os << "        auto d = instruction & 0xff;\n";
+    os << "        switch (instruction >> 8) {\n";
+    for (auto&& info : OPCODES) {
+        auto cpp = std::string{info.cpp};
+        for (auto&& placeholder : {"a", "b", "c", "x", "y"}) {
+            cpp = substitute(cpp, std::string{"{"} + placeholder + "}", placeholder);
+        }
+        cpp = substitute(cpp, "{imm}", "s.read_word(s.banks[CODE_BANK].data(), Address(s.IP + 2))");
+        cpp = substitute(cpp, "{next}", "Register(s.IP + " + std::to_string(instruction_size(info)) + ")");
+        if (instruction_size(info) > 2) {
+            cpp += " s.IP += " + std::to_string(instruction_size(info) - 2) + ";";
+        }
+        os << "            case " << hex(info.code, 2) << ": { " << decode_cpp(info.fields) << cpp << " break; }\n";
+    }
+    os << "            default: {\n";
+    os << "                // Illegal instruction trap, or halt without a handler\n";
+    os << "                auto handler = s.read_word(s.banks[MMIO_BANK].data(), IT_ADDR + IT_ENTRY_SIZE * ILLEGAL_INSTRUCTION_INTERRUPT);\n";
+    os << "                if (handler == 0x0000) {\n";
+    os << "                    s.running = false;\n";
+    os << "                    return;\n";
+    os << "                }\n";
+    os << "                s.CR &= ~0x0008;\n";
+    os << "                s.SP += 2;\n";
+    os << "                s.write_word(s.stack_bank(), s.SP, s.IP);\n";
+    os << "                s.IP = handler;\n";
+    os << "                return;\n";
+    os << "            }\n";
+    os << "        }\n";
+    os << "        s.IP += 2;\n";
+    os << "    }\n";
+
+    for (auto&& block : this->blocks) {
+        os << "\n";
+        os << "    void block_" << hex(block.start) << "(Micro16State& s)\n";
+        os << "    {\n";
+        auto last_flow = Flow::NEXT;
+        auto next = std::size_t{block.start};
+        for (auto addr = std::size_t{block.start}; addr <= block.end; addr = next) {
+            auto instruction = this->instruction_at(Address(addr));
+            auto info = *opcode_info(instruction);
+            auto ops = decode(info.fields, instruction & 0xff);
+            auto imm = hex(this->instruction_at(Address(addr + 2)));
+            next = addr + instruction_size(info);
+            os << "        /* " << hex(int(addr)) << ": " << hex(instruction) << " */ ";
+            os << instruction_cpp(info, ops, imm, hex(Address(next))) << "\n";
+            last_flow = info.flow;
+        }
+        if (last_flow == Flow::NEXT || last_flow == Flow::BRANCH) {
+            os << "        s.IP = " << hex(Address(next)) << ";\n";
+        }
+        os << "    }\n";
+    }
+    os << "}\n\n";
+
+    os << "void load_recompiled_code(Micro16State& s)\n";
+    os << "{\n";
+    os << "    std::copy(std::begin(CODE), std::end(CODE), s.banks[CODE_BANK].begin());\n";
+    os << "}\n\n";
+
+    os << "void run_recompiled(Micro16State& s)\n";
+    os << "{\n";
+    os << "    while (s.running) {\n";
+    os << "        switch (s.IP) {\n";
+    for (auto&& block : this->blocks) {
+        os << "            case " << hex(block.start) << ": block_" << hex(block.start) << "(s); break;\n";
+    }
+    os << "            default: step(s); break;\n";
+    os << "        }\n";
+    os << "    }\n";
+    os << "}\n";
+
+    if (with_main) {
+        os << "\n";
+        os << "int main()\n";
+        os << "{\n";
+        os << "    auto s = std::make_unique<Micro16State>();\n";
+        os << "    load_recompiled_code(*s);\n";
+        os << "    run_recompiled(*s);\n";
+        os << "    auto print = [](char const* name, Register value) {\n";
+        os << "        std::cout << name << \" = 0x\" << std::setw(4) << std::setfill('0') << std::hex << value << \"\\n\";\n";
+        os << "    };\n";
+        os << "    print(\"IP\", s->IP);\n";
+        os << "    print(\"CR\", s->CR);\n";
+        os << "    print(\"SP\", s->SP);\n";
+        os << "    print(\"W0\", s->W[0]);\n";
+        os << "    print(\"W1\", s->W[1]);\n";
+        os << "    print(\"W2\", s->W[2]);\n";
+        os << "    print(\"W3\", s->W[3]);\n";
+        os << "    return 0;\n";
+        os << "}\n";
+    }
+}
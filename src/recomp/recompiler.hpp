@@ -0,0 +1,50 @@
+#ifndef MICRO16_RECOMPILER_HPP
+#define MICRO16_RECOMPILER_HPP
+
+#include <specs.h>
+#include <array>
+#include <ostream>
+#include <set>
+#include <vector>
+
+// Translates a code bank into a C++ translation unit: each basic block
+// becomes a function on a Micro16State (see recomp/runtime.hpp), and a
+// dispatcher calls the block starting at the current IP. Jumps to addresses
+// that don't start a known block (e.g. computed jumps the recompiler could not
+// resolve) run on a generated interpreter, one instruction at a time, until
+// they reach a known block.
+//
+// Blocks are discovered from the entry point (0x0000), following branches
+// whose target register holds a constant, and from every constant fully
+// loaded into a register (e.g. by SETREG) that falls inside the code.
+//
+// The code is assumed not to change while it runs.
+class Recompiler {
+public:
+    struct BasicBlock {
+        Address start;
+        // Address of the last instruction of the block
+        Address end;
+    };
+
+    explicit Recompiler(std::array<Byte, BANK_SIZE> const& code);
+
+    std::vector<BasicBlock> const& get_blocks() const;
+
+    // With `with_main`, the translation unit has a main() that runs the
+    // program and prints the final CPU state.
+    void write_cpp(std::ostream& os, bool with_main = true) const;
+
+private:
+    Instruction instruction_at(Address addr) const;
+    void discover_leaders();
+    void build_blocks();
+
+    std::array<Byte, BANK_SIZE> const& code;
+    // One past the last nonzero byte of the code bank
+    std::size_t code_size;
+    std::set<Address> leaders;
+    std::vector<BasicBlock> blocks;
+};
+
+#endif //MICRO16_RECOMPILER_HPP
@@ -0,0 +1,57 @@
+#ifndef MICRO16_RECOMP_RUNTIME_HPP
+#define MICRO16_RECOMP_RUNTIME_HPP
+
+#include <specs.h>
+#include <array>
+
+// CPU state used by the C++ generated by micro16_recomp. Mirrors Micro16,
+// without peripherals, timers or interrupts other than the illegal
+// instruction trap.
+struct Micro16State {
+    bool running = true;
+    Register IP = 0x0000;
+    Register CR = 0x9000;
+    Register SP = 0x8000;
+    std::array<Register, 4> W = {0x0000, 0x0000, 0x0000, 0x0000};
+    std::array<std::array<Byte, BANK_SIZE>, N_BANKS> banks = {};
+
+    inline int overflow() const
+    {
+        return (this->CR & 0x0004) ? 1 : 0;
+    }
+
+    inline void set_overflow(bool overflow)
+    {
+        this->CR = (this->CR & ~0x0004) | (overflow ? 0x0004 : 0);
+    }
+
+    inline Byte* data_bank()
+    {
+        return this->banks[(this->CR & 0xc000) >> 14].data();
+    }
+
+    inline Byte* stack_bank()
+    {
+        return this->banks[(this->CR & 0x3000) >> 12].data();
+    }
+
+    static inline Register read_word(Byte const* bank, Address addr)
+    {
+        return (bank[addr] << 8) + (bank[Address(addr + 1)] << 0);
+    }
+
+    static inline void write_word(Byte* bank, Address addr, Register value)
+    {
+        bank[addr] = (value & 0xff00) >> 8;
+        bank[Address(addr + 1)] = (value & 0x00ff) >> 0;
+    }
+
+    inline void set_pixel(Register color, Register position)
+    {
+        auto video_byte = Address(position / 2);
+        auto offset = position % 2 == 0 ? 4 : 0;
+        this->banks[MMIO_BANK][video_byte] |= (color & 0xf) << offset;
+    }
+};
+
+#endif //MICRO16_RECOMP_RUNTIME_HPP
@@ -0,0 +1,118 @@
+#include <sampling_profiler.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    std::string hex_address(Address addr)
+    {
+        std::stringstream ss;
+        ss << "0x" << std::setw(4) << std::setfill('0') << std::hex << addr;
+        return ss.str();
+    }
+}
+
+SamplingProfiler::SamplingProfiler(std::chrono::microseconds interval)
+    : sequence(0)
+    , published_IP(0)
+    , depth(0)
+    , frames{}
+    , expected_IP(0)
+    , interval(interval)
+    , n_samples(0)
+    , stopping(false)
+    , sampler_thread(SamplingProfiler::sampler, this)
+{
+}
+
+SamplingProfiler::~SamplingProfiler()
+{
+    this->stop();
+}
+
+SamplingProfiler::Sample SamplingProfiler::snapshot() const
+{
+    auto sample = Sample{};
+    while (true) {
+        auto seq = this->sequence.load(std::memory_order_acquire);
+        if (seq % 2 == 0) {
+            sample.IP = this->published_IP.load(std::memory_order_relaxed);
+            auto depth = std::min(this->depth.load(std::memory_order_relaxed), MAX_DEPTH);
+            sample.frames.resize(depth);
+            for (int i = 0; i < depth; ++i) {
+                sample.frames[i] = this->frames[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (this->sequence.load(std::memory_order_relaxed) == seq) {
+                return sample;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void SamplingProfiler::sample()
+{
+    auto s = this->snapshot();
+    s.frames.push_back(s.IP);
+
+    std::scoped_lock _{this->samples_mutex};
+    this->samples[s.frames] += 1;
+    this->n_samples += 1;
+}
+
+void SamplingProfiler::stop()
+{
+    {
+        std::scoped_lock _{this->stop_mutex};
+        this->stopping = true;
+    }
+    this->stop_condition.notify_one();
+    if (this->sampler_thread.joinable()) {
+        this->sampler_thread.join();
+    }
+}
+
+uint64_t SamplingProfiler::get_n_samples() const
+{
+    std::scoped_lock _{this->samples_mutex};
+    return this->n_samples;
+}
+
+void SamplingProfiler::write_folded_stacks(std::ostream& os, Symbolizer const& symbolize) const
+{
+    auto name_of = [&symbolize](Address addr) {
+        auto name = symbolize ? symbolize(addr) : std::string{};
+        return name.empty() ? hex_address(addr) : name;
+    };
+
+    // Different addresses may have the same name, so merge them after symbolizing
+    auto folded_stacks = std::map<std::string, uint64_t>{};
+    {
+        std::scoped_lock _{this->samples_mutex};
+        for (auto&& [stack, count] : this->samples) {
+            auto folded = std::string{};
+            for (auto addr : stack) {
+                if (!folded.empty()) {
+                    folded += ";";
+                }
+                folded += name_of(addr);
+            }
+            folded_stacks[folded] += count;
+        }
+    }
+    for (auto&& [folded, count] : folded_stacks) {
+        os << folded << " " << count << "\n";
+    }
+}
+
+void SamplingProfiler::sampler(SamplingProfiler* self)
+{
+    auto lock = std::unique_lock{self->stop_mutex};
+    while (!self->stop_condition.wait_for(lock, self->interval, [self]() { return self->stopping; })) {
+        // Nothing was published before the first instruction
+        if (self->sequence.load(std::memory_order_acquire) != 0) {
+            self->sample();
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef MICRO16_SAMPLING_PROFILER_HPP
+#define MICRO16_SAMPLING_PROFILER_HPP
+
+#include <micro16.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Periodically samples the guest IP and call stack from a host thread, and
+// aggregates them as folded stacks (the input format of flamegraph.pl).
+//
+// Use it as a probe on Micro16::run(profiler). The probe keeps a shadow call
+// stack: a frame is pushed on CALL, on interrupt entry (detected as the IP
+// not being the one left by the previous instruction) and on illegal
+// instruction traps, and popped on RET and RETI. Guest code that changes its return addresses by hand is not followed.
+class SamplingProfiler {
+public:
+    static constexpr auto MAX_DEPTH = 64;
+    static constexpr auto DEFAULT_INTERVAL = std::chrono::microseconds{1000};
+
+    // Name of a code address, e.g. the label it belongs to. Hex address if not given.
+    using Symbolizer = std::function<std::string(Address)>;
+
+    struct Sample {
+        Address IP;
+        // Entry addresses of the called functions and interrupt handlers, outermost first
+        std::vector<Address> frames;
+    };
+
+    explicit SamplingProfiler(std::chrono::microseconds interval = DEFAULT_INTERVAL);
+    ~SamplingProfiler();
+
+    inline void on_instruction(Address IP, Instruction instruction, Address next_IP)
+    {
+        auto seq = this->sequence.load(std::memory_order_relaxed);
+        this->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (IP != this->expected_IP) {
+            this->push_frame(IP);
+        }
+        switch (instruction >> 8) {
+            case CALL_CODE:
+                this->push_frame(next_IP);
+                break;
+            case RET_CODE:
+            case RETI_CODE:
+                this->pop_frame();
+                break;
+            case JMP_CODE:
+            case BRE_CODE:
+            case BRNE_CODE:
+            case BRL_CODE:
+            case BRH_CODE:
+            case BRNZ_CODE:
+                break;
+            default: {
+                // Other instructions only move IP past themselves, unless they
+                // are illegal and the CPU entered the trap handler. Without a
+                // handler, the CPU halts on the instruction instead.
+                auto size = (instruction >> 8) == LDI_CODE ? 4 : 2;
+                if (next_IP != Address(IP + size) && next_IP != IP) {
+                    this->push_frame(next_IP);
+                }
+                break;
+            }
+        }
+        this->expected_IP = next_IP;
+        this->published_IP.store(next_IP, std::memory_order_relaxed);
+
+        this->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Takes a consistent snapshot of the state published by the probe
+    Sample snapshot() const;
+
+    // Adds a snapshot to the aggregated samples. Called by the sampling thread.
+    void sample();
+
+    // Stops the sampling thread. Called by the destructor.
+    void stop();
+
+    uint64_t get_n_samples() const;
+
+    // One "frame;frame;leaf count" line per distinct stack
+    void write_folded_stacks(std::ostream& os, Symbolizer const& symbolize = {}) const;
+
+private:
+    static void sampler(SamplingProfiler* self);
+
+    inline void push_frame(Address entry)
+    {
+        auto depth = this->depth.load(std::memory_order_relaxed);
+        if (depth < MAX_DEPTH) {
+            this->frames[depth].store(entry, std::memory_order_relaxed);
+        }
+        this->depth.store(depth + 1, std::memory_order_relaxed);
+    }
+
+    inline void pop_frame()
+    {
+        auto depth = this->depth.load(std::memory_order_relaxed);
+        if (depth > 0) {
+            this->depth.store(depth - 1, std::memory_order_relaxed);
+        }
+    }
+
+    // Written only by the CPU thread. `sequence` is odd while they are being updated.
+    std::atomic<uint32_t> sequence;
+    std::atomic<Address> published_IP;
+    std::atomic<int> depth;
+    std::array<std::atomic<Address>, MAX_DEPTH> frames;
+    Address expected_IP;
+
+    std::chrono::microseconds interval;
+    mutable std::mutex samples_mutex;
+    std::map<std::vector<Address>, uint64_t> samples;
+    uint64_t n_samples;
+
+    std::mutex stop_mutex;
+    std::condition_variable stop_condition;
+    bool stopping;
+    std::thread sampler_thread;
+};
+
+#endif //MICRO16_SAMPLING_PROFILER_HPP
@@ -1,4 +1,6 @@
 #include <sdl_screen.hpp>
+#include <trace_events.hpp>
+#include <algorithm>
 
 namespace {
     struct SDLScopedSurfaceLock {
@@ -18,6 +20,9 @@ namespace {
 }
 
 SDLScreen::SDLScreen()
+    : bus{nullptr}
+    , video_memory_ptr{nullptr}
+    , frame_count{0}
 {
     SDL_Init(SDL_INIT_VIDEO);
     this->window = SDL_CreateWindow(
@@ -36,27 +41,59 @@ SDLScreen::~SDLScreen()
     SDL_Quit();
 }
 
-inline void SDLScreen::paint_pixel(unsigned int* ptr, int i, int j, Nibble const& pixel_nibble)
+inline void SDLScreen::paint_pixel(unsigned int* ptr, int i, int j, ColorHex color)
 {
     for (int k = 0; k < SCALE; ++k) {
         for (int l = 0; l < SCALE; ++l) {
-            ptr[(SCALE * SCALE * WIDTH * i + SCALE * j) + (SCALE * WIDTH * l + k)] = bits_to_color.at(pixel_nibble);
+            ptr[(SCALE * SCALE * WIDTH * i + SCALE * j) + (SCALE * WIDTH * l + k)] = color;
         }
     }
 }
 
+inline void SDLScreen::unpack_pixels(Byte const* data, int n_bytes, Nibble* pixels)
+{
+    for (int i = 0; i < n_bytes; ++i) {
+        pixels[2 * i + 0] = (data[i] & 0xf0) >> 4;
+        pixels[2 * i + 1] = (data[i] & 0x0f) >> 0;
+    }
+}
+
+Palette SDLScreen::read_palette() const
+{
+    auto palette = Palette{};
+    auto* registers = this->video_memory_ptr + (PALETTE_ADDR - VIDEO_ADDR);
+    for (int i = 0; i < PALETTE_SIZE; ++i) {
+        palette[i] = rgb565_to_color(load_word(registers + 2 * i));
+    }
+    return palette;
+}
+
 void SDLScreen::update()
 {
     if (!this->is_connected()) {
         return;
     }
+    auto frame_event = TraceEvents::Scope{"frame"};
+    auto frame_start = std::chrono::steady_clock::now();
+    if (this->frame_count.load(std::memory_order_relaxed) != 0) {
+        this->frame_times.record(frame_start - this->last_frame_start);
+    }
+    this->last_frame_start = frame_start;
+    this->frame_count.store(this->frame_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 
     SDL_Event event;
-    if (SDL_PollEvent(&event) && event.type == SDL_QUIT) {
-        if (this->on_window_close) {
-            this->on_window_close();
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            if (this->on_window_close) {
+                this->on_window_close();
+            }
+            return;
+        } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+            // Key repetitions are left for the guest to handle
+            if (this->on_key_event && !event.key.repeat && event.key.keysym.scancode < 256) {
+                this->on_key_event(event.key.keysym.scancode, event.type == SDL_KEYDOWN);
+            }
         }
-        return;
     }
 
     SDL_Surface* surface = SDL_GetWindowSurface(this->window);
@@ -68,16 +105,33 @@ void SDLScreen::update()
         if (video_mem == nullptr) {
             return;
         }
-        auto constexpr N_BYTES_Y = HEIGHT;
-        auto constexpr N_BYTES_X = WIDTH / 2;
-        for (int i = 0; i < N_BYTES_Y; ++i) {
-            for (int j = 0; j < N_BYTES_X; ++j) {
-                auto mem_data = video_mem[N_BYTES_X * i + j];
-                auto left_nibble = (mem_data & 0xf0) >> 4;
-                auto right_nibble = (mem_data & 0x0f) >> 0;
-                paint_pixel(ptr, i, 2 * j + 0, left_nibble);
-                paint_pixel(ptr, i, 2 * j + 1, right_nibble);
+        auto palette = this->read_palette();
+        auto scroll_x = load_word(video_mem + (SCROLL_X_ADDR - VIDEO_ADDR)) % WIDTH;
+        auto scroll_y = load_word(video_mem + (SCROLL_Y_ADDR - VIDEO_ADDR)) % HEIGHT;
+        auto video_mode = load_word(video_mem + (VIDEO_MODE_ADDR - VIDEO_ADDR));
+        auto const* sheet = video_mode == VIDEO_MODE_TILES ? this->tile_sheet() : nullptr;
+        auto sprites = sheet != nullptr ? this->visible_sprites(sheet) : std::vector<Sprite>{};
+
+        auto plane = Scanline{};
+        auto line = Scanline{};
+        auto plane_row = scroll_y;
+        for (int i = 0; i < HEIGHT; ++i) {
+            if (sheet != nullptr) {
+                this->draw_tiles_line(sheet, plane_row, plane);
+            } else {
+                this->draw_bitmap_line(plane_row, plane);
             }
+
+            // Pixels from scroll_x to the end of the line are drawn first, then it wraps around
+            auto n_until_wrap = WIDTH - scroll_x;
+            std::copy(plane.begin() + scroll_x, plane.end(), line.begin());
+            std::copy(plane.begin(), plane.begin() + scroll_x, line.begin() + n_until_wrap);
+            draw_sprites_line(sprites, i, line);
+
+            for (int j = 0; j < WIDTH; ++j) {
+                paint_pixel(ptr, i, j, palette[line[j]]);
+            }
+            plane_row = (plane_row + 1 == HEIGHT) ? 0 : plane_row + 1;
         }
     }
     SDL_UpdateWindowSurface(this->window);
@@ -86,10 +140,86 @@ void SDLScreen::update()
     SDL_Delay(1);
 }
 
+Byte const* SDLScreen::tile_sheet() const
+{
+    if (this->bus == nullptr) {
+        return nullptr;
+    }
+    auto bank = load_word(this->video_memory_ptr + (TILE_SHEET_BANK_ADDR - VIDEO_ADDR)) & 0b11;
+    auto addr = load_word(this->video_memory_ptr + (TILE_SHEET_ADDR - VIDEO_ADDR));
+    if (std::size_t{addr} + 256 * TILE_BYTES > BANK_SIZE) {
+        return nullptr;
+    }
+    return this->bus->bank(bank) + addr;
+}
+
+std::vector<SDLScreen::Sprite> SDLScreen::visible_sprites(Byte const* sheet) const
+{
+    auto sprites = std::vector<Sprite>{};
+    for (int s = 0; s < N_SPRITES; ++s) {
+        auto const* entry = this->video_memory_ptr + (SPRITE_TABLE_ADDR - VIDEO_ADDR) + SPRITE_ENTRY_SIZE * s;
+        if (!(load_word(entry + SPRITE_FLAGS) & SPRITE_VISIBLE)) {
+            continue;
+        }
+        sprites.push_back({
+            static_cast<int16_t>(load_word(entry + SPRITE_X)),
+            static_cast<int16_t>(load_word(entry + SPRITE_Y)),
+            sheet + TILE_BYTES * (load_word(entry + SPRITE_TILE) & 0xff)
+        });
+    }
+    return sprites;
+}
+
+void SDLScreen::draw_bitmap_line(int row, Scanline& plane) const
+{
+    unpack_pixels(this->video_memory_ptr + row * (WIDTH / 2), WIDTH / 2, plane.data());
+}
+
+void SDLScreen::draw_tiles_line(Byte const* sheet, int row, Scanline& plane) const
+{
+    auto const* tile_map_row = this->video_memory_ptr + (TILE_MAP_ADDR - VIDEO_ADDR) + (row / TILE_SIZE) * TILE_MAP_WIDTH;
+    auto tile_row_offset = (row % TILE_SIZE) * (TILE_SIZE / 2);
+    for (int tx = 0; tx < TILE_MAP_WIDTH; ++tx) {
+        auto const* tile_row = sheet + TILE_BYTES * tile_map_row[tx] + tile_row_offset;
+        unpack_pixels(tile_row, TILE_SIZE / 2, plane.data() + TILE_SIZE * tx);
+    }
+}
+
+void SDLScreen::draw_sprites_line(std::vector<Sprite> const& sprites, int i, Scanline& line)
+{
+    // Sprites are drawn in order, so that the last ones are on top. Color 0 is transparent.
+    for (auto&& sprite : sprites) {
+        auto ty = i - sprite.y;
+        if (ty < 0 || ty >= TILE_SIZE) {
+            continue;
+        }
+        auto pixels = std::array<Nibble, TILE_SIZE>{};
+        unpack_pixels(sprite.tile + ty * (TILE_SIZE / 2), TILE_SIZE / 2, pixels.data());
+        auto first = std::max(0, -sprite.x);
+        auto last = std::min(TILE_SIZE, WIDTH - sprite.x);
+        for (int tx = first; tx < last; ++tx) {
+            if (pixels[tx] != 0) {
+                line[sprite.x + tx] = pixels[tx];
+            }
+        }
+    }
+}
+
+void SDLScreen::connect_to_bus(MemoryBus const& bus)
+{
+    std::scoped_lock _{this->video_memory_ptr_mutex};
+    this->bus = &bus;
+}
+
 void SDLScreen::connect_to_memory(Byte* memory_start)
 {
     std::scoped_lock _{this->video_memory_ptr_mutex};
     this->video_memory_ptr = memory_start;
+
+    auto* registers = this->video_memory_ptr + (PALETTE_ADDR - VIDEO_ADDR);
+    for (int i = 0; i < PALETTE_SIZE; ++i) {
+        store_word(registers + 2 * i, color_to_rgb565(DEFAULT_PALETTE[i]));
+    }
 }
 
 bool SDLScreen::is_connected() const
@@ -107,3 +237,18 @@ void SDLScreen::register_on_window_close_callback(std::function<void()> const& c
 {
     this->on_window_close = callback;
 }
+
+void SDLScreen::register_on_key_event_callback(std::function<void(Byte key_code, bool pressed)> const& callback)
+{
+    this->on_key_event = callback;
+}
+
+uint64_t SDLScreen::get_frame_count() const
+{
+    return this->frame_count.load(std::memory_order_relaxed);
+}
+
+LatencyHistogram const& SDLScreen::get_frame_times() const
+{
+    return this->frame_times;
+}
@@ -6,44 +6,104 @@
 #include <SDL2/SDL.h>
 #include <thread>
 #include <array>
-#include <unordered_map>
 #include <functional>
 
 using ColorHex = unsigned int;
+using Palette = std::array<ColorHex, PALETTE_SIZE>;
 
-static const std::unordered_map<std::bitset<4>, ColorHex> bits_to_color = {
-        {0x0, 0x191919}, {0x8, 0xccdb25},
-        {0x1, 0xcbcbcb}, {0x9, 0xccdb88},
-        {0x2, 0xac3232}, {0xA, 0xd2842a},
-        {0x3, 0xac716b}, {0xB, 0xd2ac7a},
-        {0x4, 0x4fac43}, {0xC, 0x824aad},
-        {0x5, 0x92b687}, {0xD, 0xb795c2},
-        {0x6, 0x5b69ac}, {0xE, 0x1f7d6e},
-        {0x7, 0xacadc8}, {0xF, 0x87ccc8},
+// Loaded into the palette registers when the screen is connected
+static constexpr Palette DEFAULT_PALETTE = {
+        0x191919, 0xcbcbcb, 0xac3232, 0xac716b,
+        0x4fac43, 0x92b687, 0x5b69ac, 0xacadc8,
+        0xccdb25, 0xccdb88, 0xd2842a, 0xd2ac7a,
+        0x824aad, 0xb795c2, 0x1f7d6e, 0x87ccc8,
 };
 
+// Palette registers hold RGB565 colors
+inline Register color_to_rgb565(ColorHex color)
+{
+    auto r = (color & 0xff0000) >> 16;
+    auto g = (color & 0x00ff00) >> 8;
+    auto b = (color & 0x0000ff) >> 0;
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | ((b >> 3) << 0);
+}
+
+inline ColorHex rgb565_to_color(Register value)
+{
+    auto r = (value & 0xf800) >> 11;
+    auto g = (value & 0x07e0) >> 5;
+    auto b = (value & 0x001f) >> 0;
+    return (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 0);
+}
+
 class SDLScreen : public Micro16::Adapter {
 public:
     static auto constexpr SCALE = 2;
-    static auto constexpr WIDTH = 320;
-    static auto constexpr HEIGHT = 200;
+    static auto constexpr WIDTH = VIDEO_WIDTH;
+    static auto constexpr HEIGHT = VIDEO_HEIGHT;
+
+    static auto constexpr VIDEO_MODE_BITMAP = 0;
+    static auto constexpr VIDEO_MODE_TILES = 1;
+
+    static auto constexpr TILE_SIZE = 8;
+    static auto constexpr TILE_BYTES = TILE_SIZE * TILE_SIZE / 2;
+    static auto constexpr TILE_MAP_WIDTH = WIDTH / TILE_SIZE;
+    static auto constexpr TILE_MAP_HEIGHT = HEIGHT / TILE_SIZE;
+
+    // Sprite attribute table entries
+    static auto constexpr N_SPRITES = 16;
+    static auto constexpr SPRITE_ENTRY_SIZE = 8;
+    static auto constexpr SPRITE_X = 0x00;
+    static auto constexpr SPRITE_Y = 0x02;
+    static auto constexpr SPRITE_TILE = 0x04;
+    static auto constexpr SPRITE_FLAGS = 0x06;
+    static auto constexpr SPRITE_VISIBLE = 0x0001;
 
     SDLScreen();
     ~SDLScreen();
 
     void connect_to_memory(Byte* memory_start) override;
+    void connect_to_bus(MemoryBus const& bus);
     void disconnect() override;
     bool is_connected() const override;
     void update();
     void register_on_window_close_callback(std::function<void()> const& callback);
+    void register_on_key_event_callback(std::function<void(Byte key_code, bool pressed)> const& callback);
+
+    // Can be read from any thread while the screen is updated
+    uint64_t get_frame_count() const;
+    // Time between the starts of consecutive frames
+    LatencyHistogram const& get_frame_times() const;
 
 private:
-    static inline void paint_pixel(unsigned int* ptr, int i, int j, Nibble const& mem_data);
+    // Color indexes of a screen line, before going through the palette
+    using Scanline = std::array<Nibble, WIDTH>;
+
+    struct Sprite {
+        int x;
+        int y;
+        Byte const* tile;
+    };
+
+    static inline void paint_pixel(unsigned int* ptr, int i, int j, ColorHex color);
+    static inline void unpack_pixels(Byte const* data, int n_bytes, Nibble* pixels);
+    Palette read_palette() const;
+    Byte const* tile_sheet() const;
+    std::vector<Sprite> visible_sprites(Byte const* sheet) const;
+    void draw_bitmap_line(int row, Scanline& plane) const;
+    void draw_tiles_line(Byte const* sheet, int row, Scanline& plane) const;
+    static void draw_sprites_line(std::vector<Sprite> const& sprites, int i, Scanline& line);
 
     SDL_Window* window;
+    MemoryBus const* bus;
     Byte* video_memory_ptr;
     std::mutex video_memory_ptr_mutex;
     std::function<void()> on_window_close;
+    std::function<void(Byte key_code, bool pressed)> on_key_event;
+
+    std::atomic<uint64_t> frame_count;
+    std::chrono::steady_clock::time_point last_frame_start;
+    LatencyHistogram frame_times;
 };
 
 #endif //MICRO16_SDL_SCREEN_HPP
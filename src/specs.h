@@ -16,5 +16,36 @@ static constexpr auto N_BANKS = 4;
 static constexpr auto BANK_SIZE = 64 * 1024;
 
 static constexpr auto IT_ADDR = 0x7d00;
+static constexpr auto IT_ENTRY_SIZE = 4;
+
+// Interrupt ids. Each id is also the index of its entry on the interrupt table.
+static constexpr auto TIMER0_INTERRUPT = 0;
+static constexpr auto TIMER1_INTERRUPT = 1;
+static constexpr auto DMA_INTERRUPT = 2;
+static constexpr auto KEYBOARD_INTERRUPT = 3;
+static constexpr auto DISK_INTERRUPT = 4;
+// Not raised by devices: entered right away when an unknown instruction runs
+static constexpr auto ILLEGAL_INSTRUCTION_INTERRUPT = 5;
+
+static constexpr auto KEYBOARD_ADDR = 0x7e00;
+
+static constexpr auto VIDEO_ADDR = 0x0000;
+static constexpr auto VIDEO_WIDTH = 320;
+static constexpr auto VIDEO_HEIGHT = 200;
+
+static constexpr auto DMA_ADDR = 0x7f00;
+static constexpr auto BLITTER_ADDR = 0x7f10;
+static constexpr auto PALETTE_ADDR = 0x7f20;
+static constexpr auto PALETTE_SIZE = 16;
+static constexpr auto SCROLL_X_ADDR = 0x7f40;
+static constexpr auto SCROLL_Y_ADDR = 0x7f42;
+static constexpr auto VIDEO_MODE_ADDR = 0x7f44;
+static constexpr auto TILE_SHEET_BANK_ADDR = 0x7f46;
+static constexpr auto TILE_SHEET_ADDR = 0x7f48;
+static constexpr auto DISK_ADDR = 0x7f50;
+
+// Used instead of the video memory on the tile video mode
+static constexpr auto TILE_MAP_ADDR = 0x0000;
+static constexpr auto SPRITE_TABLE_ADDR = 0x0400;
 
 #endif //MICRO16_SPECS_H
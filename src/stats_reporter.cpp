@@ -0,0 +1,124 @@
+#include <stats_reporter.hpp>
+#include <iomanip>
+
+namespace {
+    double to_ms(std::chrono::nanoseconds duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    double to_us(std::chrono::nanoseconds duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    template <typename Unit>
+    void write_percentiles_text(std::ostream& os, LatencyHistogram const& histogram, Unit to_unit, char const* unit)
+    {
+        os << "p50 " << to_unit(histogram.percentile(50)) << unit;
+        os << " p90 " << to_unit(histogram.percentile(90)) << unit;
+        os << " p99 " << to_unit(histogram.percentile(99)) << unit;
+        os << " max " << to_unit(histogram.get_max()) << unit;
+    }
+
+    template <typename Unit>
+    void write_percentiles_json(std::ostream& os, LatencyHistogram const& histogram, Unit to_unit)
+    {
+        os << "{\"count\": " << histogram.get_count();
+        os << ", \"p50\": " << to_unit(histogram.percentile(50));
+        os << ", \"p90\": " << to_unit(histogram.percentile(90));
+        os << ", \"p99\": " << to_unit(histogram.percentile(99));
+        os << ", \"max\": " << to_unit(histogram.get_max()) << "}";
+    }
+}
+
+StatsReporter::StatsReporter(
+    Micro16 const& mcu,
+    SDLScreen const& screen,
+    std::ostream& os,
+    Format format,
+    std::chrono::milliseconds period
+)
+    : mcu(mcu)
+    , screen(screen)
+    , os(os)
+    , format(format)
+    , period(period)
+    , start(std::chrono::steady_clock::now())
+    , last_report(start)
+    , last_instruction_count(mcu.get_instruction_count())
+    , last_frame_count(screen.get_frame_count())
+    , stopping(false)
+    , reporter_thread(StatsReporter::reporter, this)
+{
+}
+
+StatsReporter::~StatsReporter()
+{
+    this->stop();
+}
+
+void StatsReporter::report()
+{
+    std::scoped_lock _{this->mutex};
+    this->write_report();
+}
+
+void StatsReporter::write_report()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto instruction_count = this->mcu.get_instruction_count();
+    auto frame_count = this->screen.get_frame_count();
+    auto elapsed = std::chrono::duration<double>(now - this->last_report).count();
+    auto mips = elapsed > 0 ? double(instruction_count - this->last_instruction_count) / elapsed / 1e6 : 0.0;
+    auto fps = elapsed > 0 ? double(frame_count - this->last_frame_count) / elapsed : 0.0;
+    this->last_report = now;
+    this->last_instruction_count = instruction_count;
+    this->last_frame_count = frame_count;
+
+    auto& frame_times = this->screen.get_frame_times();
+    auto& interrupt_latency = this->mcu.get_timer_interrupt_latency();
+    auto resident_kb = this->mcu.get_bus().get_resident_size() / 1024;
+    auto time = std::chrono::duration<double>(now - this->start).count();
+    auto& os = this->os;
+    os << std::fixed << std::setprecision(3);
+    if (this->format == Format::TEXT) {
+        os << "[stats " << std::setprecision(1) << time << "s] " << std::setprecision(3);
+        os << mips << " MIPS, " << fps << " FPS, frame time ";
+        write_percentiles_text(os, frame_times, to_ms, "ms");
+        os << ", timer interrupt latency ";
+        write_percentiles_text(os, interrupt_latency, to_us, "us");
+        os << ", " << resident_kb << "KB resident memory";
+        os << std::endl;
+    } else {
+        os << "{\"time_s\": " << time;
+        os << ", \"instructions\": " << instruction_count << ", \"mips\": " << mips;
+        os << ", \"frames\": " << frame_count << ", \"fps\": " << fps;
+        os << ", \"frame_time_ms\": ";
+        write_percentiles_json(os, frame_times, to_ms);
+        os << ", \"timer_interrupt_latency_us\": ";
+        write_percentiles_json(os, interrupt_latency, to_us);
+        os << ", \"resident_memory_kb\": " << resident_kb;
+        os << "}" << std::endl;
+    }
+}
+
+void StatsReporter::stop()
+{
+    {
+        std::scoped_lock _{this->mutex};
+        this->stopping = true;
+    }
+    this->stop_condition.notify_one();
+    if (this->reporter_thread.joinable()) {
+        this->reporter_thread.join();
+    }
+}
+
+void StatsReporter::reporter(StatsReporter* self)
+{
+    auto lock = std::unique_lock{self->mutex};
+    while (!self->stop_condition.wait_for(lock, self->period, [self]() { return self->stopping; })) {
+        self->write_report();
+    }
+}
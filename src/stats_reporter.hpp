@@ -0,0 +1,51 @@
+#ifndef MICRO16_STATS_REPORTER_HPP
+#define MICRO16_STATS_REPORTER_HPP
+
+#include <micro16.hpp>
+#include <sdl_screen.hpp>
+#include <condition_variable>
+#include <ostream>
+
+// Periodically writes the runtime statistics of the CPU and the screen:
+// guest MIPS, FPS, frame times and timer interrupt latency. MIPS and FPS are
+// measured over the last period, percentiles since the start.
+class StatsReporter {
+public:
+    enum class Format {
+        // One human readable line per report
+        TEXT,
+        // One JSON object per line
+        JSON,
+    };
+
+    StatsReporter(Micro16 const& mcu, SDLScreen const& screen, std::ostream& os, Format format, std::chrono::milliseconds period);
+    ~StatsReporter();
+
+    // Writes a report now, besides the periodic ones
+    void report();
+
+    // Stops the periodic reports. Called by the destructor.
+    void stop();
+
+private:
+    static void reporter(StatsReporter* self);
+    void write_report();
+
+    Micro16 const& mcu;
+    SDLScreen const& screen;
+    std::ostream& os;
+    Format format;
+    std::chrono::milliseconds period;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last_report;
+    uint64_t last_instruction_count;
+    uint64_t last_frame_count;
+
+    std::mutex mutex;
+    std::condition_variable stop_condition;
+    bool stopping;
+    std::thread reporter_thread;
+};
+
+#endif //MICRO16_STATS_REPORTER_HPP
@@ -4,7 +4,37 @@
 
 using namespace std::string_literals;
 
-void check_mcu_state(Micro16 const& mcu, Micro16::InternalState const& expected_state)
+inline void check_mcu_state(Micro16 const& mcu, Micro16::InternalState const& expected_state)
 {
     CHECK(mcu.get_state() == expected_state);
 }
+
+// Helps writing longer test programs, where hand-writing each instruction
+// would be impractical.
+struct ProgramWriter {
+    std::array<Byte, BANK_SIZE> code{};
+    Address pos = 0x0000;
+
+    void emit(Byte instruction_code, Byte instruction_data = 0b00000000)
+    {
+        this->code[this->pos + 0] = instruction_code;
+        this->code[this->pos + 1] = instruction_data;
+        this->pos += 2;
+    }
+
+    // With four SET instructions
+    void set_register(int reg, Register value)
+    {
+        for (int yy = 3; yy >= 0; --yy) {
+            this->emit(SET_CODE, (reg << 6) | (yy << 4) | ((value >> (4 * yy)) & 0xf));
+        }
+    }
+
+    // Stores `value` at `addr` on the selected bank. Overwrites W0 and W1.
+    void store(Address addr, Register value)
+    {
+        this->set_register(0, addr);
+        this->set_register(1, value);
+        this->emit(ST_CODE, 0b00000001);
+    }
+};
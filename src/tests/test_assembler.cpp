@@ -45,6 +45,17 @@ TEST_CASE("Assembler", MICRO16_ASSEMBLER_TAG) {
     check_next_instruction("SET", 0b00001000, 0b11011010);
     check_next_instruction("CLR", 0b00001010, 0b00000011);
     check_next_instruction("NOT", 0b00001011, 0b00000011);
+    check_next_instruction("LDI", 0b00001001, 0b00000010);
+    check_next_instruction("LDI (value)", 0xbe, 0xef);
+    check_next_instruction("ADDI", 0b00001100, 0b01111101);
+    check_next_instruction("ADDI", 0b00001100, 0b01011111);
+    check_next_instruction("SHL", 0b00001101, 0b01000100);
+    check_next_instruction("SHR", 0b00001110, 0b10001111);
+    check_next_instruction("MUL", 0b00001111, 0b11000110);
+    check_next_instruction("DIV", 0b00010000, 0b00000110);
+    check_next_instruction("MOD", 0b00010001, 0b00000110);
+    check_next_instruction("ADC", 0b00010010, 0b00000110);
+    check_next_instruction("SBC", 0b00010011, 0b00000110);
 
     /* Branch instructions */
     check_next_instruction("JMP",  0b10000000, 0b00000000);
@@ -72,22 +83,20 @@ TEST_CASE("Assembler", MICRO16_ASSEMBLER_TAG) {
     check_next_instruction("EAI",  0b11000001, 0b00000000);
     check_next_instruction("DTI",  0b11000010, 0b00000001);
     check_next_instruction("ETI",  0b11000011, 0b00000001);
+    check_next_instruction("DII",  0b11000101, 0b00000010);
+    check_next_instruction("EII",  0b11000110, 0b00000001);
     check_next_instruction("SELB", 0b11000100, 0b00000011);
     check_next_instruction("BRK",  0b11111110, 0b00000000);
     check_next_instruction("HLT",  0b11111111, 0b00000000);
 
     /* Pseudo instruction */
     /* SETREG expansion */
-    check_next_instruction("SET", 0b00001000, 0b00110001);
-    check_next_instruction("SET", 0b00001000, 0b00100010);
-    check_next_instruction("SET", 0b00001000, 0b00010011);
-    check_next_instruction("SET", 0b00001000, 0b00000100);
+    check_next_instruction("LDI", 0b00001001, 0b00000000);
+    check_next_instruction("LDI (value)", 0x12, 0x34);
 
     /* SETREG expansion */
-    check_next_instruction("SET", 0b00001000, 0b01111111);
-    check_next_instruction("SET", 0b00001000, 0b01101111);
-    check_next_instruction("SET", 0b00001000, 0b01011111);
-    check_next_instruction("SET", 0b00001000, 0b01001111);
+    check_next_instruction("LDI", 0b00001001, 0b00000001);
+    check_next_instruction("LDI (value)", 0xff, 0xff);
 
     /* PUSHALL expansion */
     check_next_instruction("PUSH", 0b01001000, 0b00000000);
@@ -130,16 +139,11 @@ TEST_CASE("Sections", MICRO16_ASSEMBLER_TAG) {
 
     /* Label resolution  */
     auto extract_label_resolution_from_SETREG_at = [&](auto pos) {
-        auto obtained_label_resolution = std::bitset<16>{0x0000};
         obtained_bin.seekg(pos);
+        REQUIRE(obtained_bin.get() == LDI_CODE);
         (void) obtained_bin.get();
-        obtained_label_resolution |= (obtained_bin.get() & 0x0f) << 12;
-        (void) obtained_bin.get();
-        obtained_label_resolution |= (obtained_bin.get() & 0x0f) << 8;
-        (void) obtained_bin.get();
-        obtained_label_resolution |= (obtained_bin.get() & 0x0f) << 4;
-        (void) obtained_bin.get();
-        obtained_label_resolution |= (obtained_bin.get() & 0x0f) << 0;
+        auto obtained_label_resolution = obtained_bin.get() << 8;
+        obtained_label_resolution |= obtained_bin.get();
         return obtained_label_resolution;
     };
     /* SETREG expansion with label *before* definition */
@@ -147,3 +151,50 @@ TEST_CASE("Sections", MICRO16_ASSEMBLER_TAG) {
     /* SETREG expansion with label *after* definition */
     REQUIRE(extract_label_resolution_from_SETREG_at(0x2abc) == 0x2abc);
 }
+
+TEST_CASE("Debug info", MICRO16_ASSEMBLER_TAG) {
+    auto input_file = "test_assembler/sections.m16asm";
+    auto tokens = Lexer::tokens_from_file(input_file);
+    auto debug_info = DebugInfo{};
+    debug_info.source_file = "sections.m16asm";
+    (void) Parser::generate_instruction_list(tokens, &debug_info);
+
+    REQUIRE(debug_info.lines.size() == 10);
+    REQUIRE(debug_info.describe(0x0000) == "sections.m16asm:3");
+    REQUIRE(debug_info.describe(0x0004) == "sections.m16asm:5");
+    REQUIRE(debug_info.describe(0x1004) == "sections.m16asm:10");
+    REQUIRE(debug_info.describe(0x2000) == "sections.m16asm:13 (SETREG)");
+    REQUIRE(debug_info.describe(0x2002) == "sections.m16asm:13 (SETREG)");
+    REQUIRE(debug_info.describe(0x2abe) == "sections.m16asm:16 (SETREG)");
+    REQUIRE(debug_info.describe(0x2004) == "");
+
+    REQUIRE(debug_info.labels.at("some_label") == 0x2abc);
+    REQUIRE(debug_info.symbolize(0x2abc) == "some_label");
+    REQUIRE(debug_info.symbolize(0x2ac2) == "some_label+0x6");
+    REQUIRE(debug_info.symbolize(0x2000) == "");
+
+    auto serialized = std::stringstream{};
+    debug_info.write(serialized);
+    auto read_back = DebugInfo::read(serialized);
+    REQUIRE(read_back.source_file == debug_info.source_file);
+    REQUIRE(read_back.labels == debug_info.labels);
+    REQUIRE(read_back.lines.size() == debug_info.lines.size());
+    REQUIRE(read_back.describe(0x2000) == "sections.m16asm:13 (SETREG)");
+    REQUIRE(read_back.describe(0x1004) == "sections.m16asm:10");
+}
+
+TEST_CASE("Malformed sources", MICRO16_ASSEMBLER_TAG) {
+    auto assemble = [](std::string const& source) {
+        return Parser::generate_instruction_list(Lexer::tokens_from_string(source));
+    };
+
+    REQUIRE(assemble("HLT // no line break after a comment").size() == 1);
+    REQUIRE_THROWS_AS(assemble("HLT /* unterminated"), LexerError);
+    REQUIRE_THROWS_AS(assemble("ADD W0 W1"), ParserError);
+    REQUIRE_THROWS_AS(assemble("SETREG W0"), ParserError);
+    REQUIRE_THROWS_AS(assemble(".data 0x"), ParserError);
+    REQUIRE_THROWS_AS(assemble(".data 99999999999"), ParserError);
+    REQUIRE_THROWS_AS(assemble("ADDI W0 32"), ParserError);
+    REQUIRE_THROWS_AS(assemble("ADDI W0 -33"), ParserError);
+    REQUIRE_THROWS_AS(assemble("SHL W0 16"), ParserError);
+}
@@ -1,6 +1,9 @@
 #include <tests/catch.hpp>
 #include <tests/catch_extensions.hpp>
 #include <micro16.hpp>
+#include <algorithm>
+#include <utility>
+#include <unistd.h>
 
 auto constexpr MICRO16_INSTRUCTIONS_TAG = "[micro16 instructions]";
 
@@ -378,3 +381,267 @@ TEST_CASE("Set pixel", MICRO16_INSTRUCTIONS_TAG) {
     REQUIRE(mcu.get_state().running == false);
     REQUIRE(mcu.get_state().IP == 0x0012);
 }
+
+class WatchedRegistersAdapter : public Micro16::Adapter
+{
+public:
+    void connect_to_memory(Byte* memory_start) { this->memory_ptr = memory_start; }
+    bool is_connected() const { return this->memory_ptr != nullptr; }
+    void disconnect() { this->memory_ptr = nullptr; }
+    void on_write(Address offset) override { this->written_offsets.push_back(offset); }
+
+    std::vector<Address> written_offsets;
+
+private:
+    Byte* memory_ptr;
+};
+
+TEST_CASE("MMIO write notifications", MICRO16_INSTRUCTIONS_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SELB_CODE, 0b00000001,
+/*0x0002*/    SET_CODE,  0b00110111,
+/*0x0004*/    SET_CODE,  0b00101111,
+/*0x0006*/    SET_CODE,  0b00010001,
+/*0x0008*/    ST_CODE,   0b00000000,
+/*0x000a*/    SET_CODE,  0b00010000,
+/*0x000c*/    ST_CODE,   0b00000000,
+/*0x000e*/    SET_CODE,  0b00010001,
+/*0x0010*/    SET_CODE,  0b00001110,
+/*0x0012*/    ST_CODE,   0b00000000,
+/*0x0014*/    SELB_CODE, 0b00000010,
+/*0x0016*/    SET_CODE,  0b00010001,
+/*0x0018*/    SET_CODE,  0b00000000,
+/*0x001a*/    ST_CODE,   0b00000000,
+/*0x001c*/    HLT_CODE,  0b00000000,
+    };
+
+    Micro16 mcu{code};
+    WatchedRegistersAdapter adapter;
+    mcu.register_mmio(adapter, Address{0x7f10}, Address{0x0010});
+    mcu.run();
+
+    // Stores to 0x7f10 and 0x7f1e (bank 1) are watched. Stores to 0x7f00
+    // (bank 1) and 0x7f10 (bank 2) are not.
+    REQUIRE(adapter.written_offsets == std::vector<Address>{0x0000, 0x000e});
+}
+
+TEST_CASE("Self modifying code on a shared code bank", MICRO16_INSTRUCTIONS_TAG) {
+    auto code = std::make_shared<MemoryBus::Bank const>(MemoryBus::Bank{
+/*0x0000*/    SET_CODE,  0b00001010,
+/*0x0002*/    SET_CODE,  0b01101111,
+/*0x0004*/    SET_CODE,  0b01111111,
+/*0x0006*/    SELB_CODE, 0b00000000,
+/*0x0008*/    ST_CODE,   0b00000001,
+/*0x000a*/    INC_CODE,  0b00000010,
+/*0x000c*/    HLT_CODE,  0b00000000,
+    });
+
+    Micro16 first{code};
+    Micro16 second{code};
+    REQUIRE(first.get_bus().is_shared(CODE_BANK));
+
+    // Overwrites INC W2 with HLT
+    first.run();
+    REQUIRE(first.get_state().IP == 0x000c);
+    REQUIRE(first.get_state().W2 == 0x0000);
+    REQUIRE(!first.get_bus().is_shared(CODE_BANK));
+    REQUIRE((*code)[0x000a] == INC_CODE);
+    REQUIRE(second.get_bus().is_shared(CODE_BANK));
+    REQUIRE(std::as_const(second.get_bus()).bank(CODE_BANK)[0x000a] == INC_CODE);
+
+    second.run();
+    REQUIRE(second.get_state() == first.get_state());
+    REQUIRE((*code)[0x000a] == INC_CODE);
+}
+
+TEST_CASE("Memory banks are allocated lazily", MICRO16_INSTRUCTIONS_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SELB_CODE, 0b00000011,
+/*0x0002*/    SET_CODE,  0b00111000,
+/*0x0004*/    ST_CODE,   0b00000000,
+/*0x0006*/    SET_CODE,  0b10110100,
+/*0x0008*/    LD_CODE,   0b00001001,
+/*0x000a*/    HLT_CODE,  0b00000000,
+    };
+
+    Micro16 mcu{code};
+    REQUIRE(mcu.get_bus().get_resident_size() == 0);
+
+    // Only the page holding 0x8000 in bank 3 is written, 0x4000 is only read
+    mcu.run();
+    auto page_size = std::min(std::size_t(sysconf(_SC_PAGESIZE)), std::size_t{BANK_SIZE});
+    REQUIRE(mcu.get_bus().get_resident_size() == page_size);
+    REQUIRE(std::as_const(mcu.get_bus()).bank(3)[0x8000] == 0x80);
+}
+
+TEST_CASE("Illegal instructions", MICRO16_INSTRUCTIONS_TAG) {
+    SECTION("Without a handler, the CPU halts on the instruction") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    INC_CODE,  0b00000000,
+/*0x0002*/    0x3f,      0b00000000,
+/*0x0004*/    HLT_CODE,  0b00000000,
+        };
+
+        Micro16 mcu{code};
+        REQUIRE(mcu.get_exit_reason() == Micro16::ExitReason::RUNNING);
+        mcu.run();
+        REQUIRE(mcu.get_exit_reason() == Micro16::ExitReason::ILLEGAL_INSTRUCTION);
+        REQUIRE(mcu.get_state() == Micro16::InternalState{false, 0x0002, 0x9000, 0x8000, 0x0001, 0x0000, 0x0000, 0x0000});
+    }
+
+    SECTION("The handler in the interrupt table gets the address of the instruction") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SELB_CODE, 0b00000001,
+/*0x0002*/    SET_CODE,  0b00110111,
+/*0x0004*/    SET_CODE,  0b00101101,
+/*0x0006*/    SET_CODE,  0b00010001,
+/*0x0008*/    SET_CODE,  0b00000100,
+/*0x000a*/    SET_CODE,  0b01010001,
+/*0x000c*/    ST_CODE,   0b00000001,
+/*0x000e*/    0x3f,      0b00000000,
+/*0x0010*/    POP_CODE,  0b00000010,
+/*0x0012*/    HLT_CODE,  0b00000000,
+        };
+
+        Micro16 mcu{code};
+        mcu.run();
+        REQUIRE(mcu.get_exit_reason() == Micro16::ExitReason::HALT);
+        REQUIRE(mcu.get_state() == Micro16::InternalState{false, 0x0014, 0x5000, 0x8000, 0x7d14, 0x0010, 0x000e, 0x0000});
+    }
+}
+
+TEST_CASE("Load and add immediate", MICRO16_INSTRUCTIONS_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000001,
+/*0x0002*/    0xbe,      0xef,
+/*0x0004*/    LDI_CODE,  0b00000010,
+/*0x0006*/    0x00,      0x01,
+/*0x0008*/    ADDI_CODE, 0b01011111,
+/*0x000a*/    ADDI_CODE, 0b10100000,
+/*0x000c*/    ADDI_CODE, 0b00111111,
+/*0x000e*/    HLT_CODE,  0b00000000,
+    };
+
+    Micro16 mcu{code};
+    mcu.run();
+    // 0xbeef + 31, 1 - 32 and 0 - 1
+    check_mcu_state(mcu, Micro16::InternalState{false, 0x0010, 0x9000, 0x8000, 0xffff, 0xbf0e, 0xffe1, 0x0000});
+    REQUIRE(mcu.get_instruction_count() == 6);
+}
+
+TEST_CASE("32 bits arithmetic with the carry flag", MICRO16_INSTRUCTIONS_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000000,
+/*0x0002*/    0xff,      0xff,
+/*0x0004*/    LDI_CODE,  0b00000001,
+/*0x0006*/    0x00,      0x01,
+/*0x0008*/    LDI_CODE,  0b00000010,
+/*0x000a*/    0x00,      0x01,
+/*0x000c*/    LDI_CODE,  0b00000011,
+/*0x000e*/    0x00,      0x02,
+/*0x0010*/    HLT_CODE,  0b00000000,
+    };
+
+    SECTION("Add with carry") {
+        // 0x0001ffff + 0x00020001
+        code[0x0010] = ADD_CODE;
+        code[0x0011] = 0b00000010;
+        code[0x0012] = ADC_CODE;
+        code[0x0013] = 0b00010111;
+        code[0x0014] = HLT_CODE;
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x0016, 0x9000, 0x8000, 0x0000, 0x0004, 0x0001, 0x0002});
+    }
+
+    SECTION("Subtract with borrow") {
+        // 0x00020001 - 0x0001ffff
+        code[0x0010] = SUB_CODE;
+        code[0x0011] = 0b00001000;
+        code[0x0012] = SBC_CODE;
+        code[0x0013] = 0b00011101;
+        code[0x0014] = HLT_CODE;
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x0016, 0x9000, 0x8000, 0x0002, 0x0000, 0x0001, 0x0002});
+    }
+
+    SECTION("The last carry is left in OV") {
+        // 0x0001 - 0xffff
+        code[0x0010] = SUB_CODE;
+        code[0x0011] = 0b00000100;
+        code[0x0012] = HLT_CODE;
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x0014, 0x9004, 0x8000, 0x0002, 0x0001, 0x0001, 0x0002});
+    }
+}
+
+TEST_CASE("Shift, multiply and divide", MICRO16_INSTRUCTIONS_TAG) {
+    SECTION("Shifts set OV to the last bit shifted out") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000000,
+/*0x0002*/    0x80,      0x01,
+/*0x0004*/    CPY_CODE,  0b00000001,
+/*0x0006*/    CPY_CODE,  0b00000010,
+/*0x0008*/    SHL_CODE,  0b00000001,
+/*0x000a*/    SHR_CODE,  0b01000100,
+/*0x000c*/    SHR_CODE,  0b10000001,
+/*0x000e*/    HLT_CODE,  0b00000000,
+        };
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x0010, 0x9004, 0x8000, 0x0002, 0x0800, 0x4000, 0x0000});
+    }
+
+    SECTION("Multiply into two registers, divide and take the remainder") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000001,
+/*0x0002*/    0x12,      0x34,
+/*0x0004*/    LDI_CODE,  0b00000010,
+/*0x0006*/    0x01,      0x00,
+/*0x0008*/    MUL_CODE,  0b11000110,
+/*0x000a*/    DIV_CODE,  0b00100110,
+/*0x000c*/    MOD_CODE,  0b00000110,
+/*0x000e*/    HLT_CODE,  0b00000000,
+        };
+
+        // 0x1234 * 0x0100, then 0x1234 / 0x0100 and 0x1234 % 0x0012
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x0010, 0x9000, 0x8000, 0x0010, 0x1234, 0x0012, 0x0012});
+    }
+
+    SECTION("The high word of a product sets OV") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000001,
+/*0x0002*/    0x12,      0x34,
+/*0x0004*/    LDI_CODE,  0b00000010,
+/*0x0006*/    0x01,      0x00,
+/*0x0008*/    MUL_CODE,  0b11000110,
+/*0x000a*/    HLT_CODE,  0b00000000,
+        };
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x000c, 0x9004, 0x8000, 0x3400, 0x1234, 0x0100, 0x0012});
+    }
+
+    SECTION("Dividing by zero sets OV") {
+        auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000001,
+/*0x0002*/    0x12,      0x34,
+/*0x0004*/    DIV_CODE,  0b00000110,
+/*0x0006*/    MOD_CODE,  0b00110110,
+/*0x0008*/    HLT_CODE,  0b00000000,
+        };
+
+        Micro16 mcu{code};
+        mcu.run();
+        check_mcu_state(mcu, Micro16::InternalState{false, 0x000a, 0x9004, 0x8000, 0xffff, 0x1234, 0x0000, 0x1234});
+    }
+}
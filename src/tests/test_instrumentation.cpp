@@ -0,0 +1,367 @@
+#include <tests/catch.hpp>
+#include <tests/catch_extensions.hpp>
+#include <micro16.hpp>
+#include <profiler.hpp>
+#include <trace.hpp>
+#include <sampling_profiler.hpp>
+#include <trace_events.hpp>
+#include <histogram.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+auto constexpr MICRO16_INSTRUMENTATION_TAG = "[micro16 instrumentation]";
+
+TEST_CASE("Execution profiler", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b00000011,
+/*0x0002*/    SET_CODE,  0b01000100,
+/*0x0004*/    DEC_CODE,  0b00000000,
+/*0x0006*/    BRNZ_CODE, 0b00000100,
+/*0x0008*/    HLT_CODE,  0b00000000,
+    };
+
+    Micro16 mcu{code};
+    ExecutionProfiler profiler;
+    mcu.run(profiler);
+
+    REQUIRE(profiler.get_executions(0x0000) == 1);
+    REQUIRE(profiler.get_executions(0x0004) == 3);
+    REQUIRE(profiler.get_executions(0x0006) == 3);
+    REQUIRE(profiler.get_taken_branches(0x0006) == 2);
+    REQUIRE(profiler.get_executions(0x0008) == 1);
+    REQUIRE(profiler.get_executions(0x000a) == 0);
+
+    auto report = std::stringstream{};
+    profiler.write_report(report, code.data(), [](Address addr) {
+        return "test.m16asm:" + std::to_string(addr / 2 + 1);
+    });
+    auto text = report.str();
+    REQUIRE(text.find("Executed instructions: 9") != std::string::npos);
+    REQUIRE(text.find("0x0004-0x0006     3               6") != std::string::npos);
+    REQUIRE(text.find("test.m16asm:3") != std::string::npos);
+}
+
+TEST_CASE("Trace recorder", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b00000011,
+/*0x0002*/    SET_CODE,  0b01000100,
+/*0x0004*/    DEC_CODE,  0b00000000,
+/*0x0006*/    BRNZ_CODE, 0b00000100,
+/*0x0008*/    PUSH_CODE, 0b00000001,
+/*0x000a*/    HLT_CODE,  0b00000000,
+    };
+    auto trace_file = (std::filesystem::temp_directory_path() / "micro16_test.trace").string();
+
+    {
+        Micro16 mcu{code};
+        TraceRecorder recorder{mcu, trace_file};
+        mcu.run(recorder);
+    }
+
+    auto expected = std::vector<TraceRecord>{
+        {0x0000, 0x0803, 0, 0x0003},
+        {0x0002, 0x0844, 1, 0x0004},
+        {0x0004, 0x0700, 0, 0x0002},
+        {0x0006, 0x8904, TraceRecord::NO_REGISTER, 0},
+        {0x0004, 0x0700, 0, 0x0001},
+        {0x0006, 0x8904, TraceRecord::NO_REGISTER, 0},
+        {0x0004, 0x0700, 0, 0x0000},
+        {0x0006, 0x8904, TraceRecord::NO_REGISTER, 0},
+        {0x0008, 0x4801, TraceRecord::REG_SP, 0x8002},
+        {0x000a, 0xff00, TraceRecord::NO_REGISTER, 0},
+    };
+    auto reader = TraceReader{trace_file};
+    REQUIRE(reader.get_initial_registers()[TraceRecord::REG_SP] == 0x8000);
+    auto record = TraceRecord{};
+    for (auto&& e : expected) {
+        REQUIRE(reader.next(record));
+        CHECK(record.IP == e.IP);
+        CHECK(record.instruction == e.instruction);
+        CHECK(record.changed_register == e.changed_register);
+        CHECK(record.value == e.value);
+    }
+    REQUIRE(!reader.next(record));
+
+    std::filesystem::remove(trace_file);
+}
+
+TEST_CASE("Sampling profiler call stacks", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b00010001,
+/*0x0002*/    CALL_CODE, 0b00000000,
+/*0x0004*/    HLT_CODE,  0b00000000,
+    };
+    auto const function_f = std::array<Byte, 6>{
+/*0x0010*/    SET_CODE,  0b01010010,
+/*0x0012*/    CALL_CODE, 0b00000001,
+/*0x0014*/    RET_CODE,  0b00000000,
+    };
+    auto const function_g = std::array<Byte, 4>{
+/*0x0020*/    BRK_CODE,  0b00000000,
+/*0x0022*/    RET_CODE,  0b00000000,
+    };
+    std::copy(function_f.begin(), function_f.end(), code.begin() + 0x10);
+    std::copy(function_g.begin(), function_g.end(), code.begin() + 0x20);
+
+    // Only take the samples requested by the test
+    SamplingProfiler profiler{std::chrono::hours{1}};
+    Micro16 mcu{code};
+    auto sample_at_breakpoint = SamplingProfiler::Sample{};
+    mcu.set_breakpoint_handler([&]() {
+        sample_at_breakpoint = profiler.snapshot();
+        profiler.sample();
+    });
+    mcu.run(profiler);
+    profiler.stop();
+
+    REQUIRE(sample_at_breakpoint.IP == 0x0020);
+    REQUIRE(sample_at_breakpoint.frames == std::vector<Address>{0x0010, 0x0020});
+    REQUIRE(profiler.snapshot().frames.empty());
+    REQUIRE(profiler.get_n_samples() == 1);
+
+    auto folded_stacks = std::stringstream{};
+    profiler.write_folded_stacks(folded_stacks, [](Address addr) {
+        return addr == 0x0010 ? "f"s : addr == 0x0020 ? "g"s : ""s;
+    });
+    REQUIRE(folded_stacks.str() == "f;g;g 1\n");
+}
+
+TEST_CASE("Sampling profiler follows illegal instruction traps", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SELB_CODE, 0b00000001,
+/*0x0002*/    LDI_CODE,  0b00000000,
+/*0x0004*/    0x7d,      0x14,
+/*0x0006*/    LDI_CODE,  0b00000001,
+/*0x0008*/    0x00,      0x30,
+/*0x000a*/    ST_CODE,   0b00000001,
+/*0x000c*/    LDI_CODE,  0b00000001,
+/*0x000e*/    0x00,      0x20,
+/*0x0010*/    CALL_CODE, 0b00000001,
+/*0x0012*/    HLT_CODE,  0b00000000,
+    };
+    auto const function_f = std::array<Byte, 6>{
+/*0x0020*/    0x3f,      0b00000000,
+/*0x0022*/    BRK_CODE,  0b00000000,
+/*0x0024*/    RET_CODE,  0b00000000,
+    };
+    // Returns past the illegal instruction
+    auto const trap_handler = std::array<Byte, 10>{
+/*0x0030*/    BRK_CODE,  0b00000000,
+/*0x0032*/    POP_CODE,  0b00000010,
+/*0x0034*/    ADDI_CODE, 0b10000010,
+/*0x0036*/    PUSH_CODE, 0b00000010,
+/*0x0038*/    RETI_CODE, 0b00000000,
+    };
+    std::copy(function_f.begin(), function_f.end(), code.begin() + 0x20);
+    std::copy(trap_handler.begin(), trap_handler.end(), code.begin() + 0x30);
+
+    SamplingProfiler profiler{std::chrono::hours{1}};
+    Micro16 mcu{code};
+    auto samples_at_breakpoints = std::vector<SamplingProfiler::Sample>{};
+    mcu.set_breakpoint_handler([&]() {
+        samples_at_breakpoints.push_back(profiler.snapshot());
+    });
+    mcu.run(profiler);
+    profiler.stop();
+
+    REQUIRE(mcu.get_exit_reason() == Micro16::ExitReason::HALT);
+    REQUIRE(samples_at_breakpoints.size() == 2);
+    REQUIRE(samples_at_breakpoints[0].IP == 0x0030);
+    REQUIRE(samples_at_breakpoints[0].frames == std::vector<Address>{0x0020, 0x0030});
+    REQUIRE(samples_at_breakpoints[1].IP == 0x0022);
+    REQUIRE(samples_at_breakpoints[1].frames == std::vector<Address>{0x0020});
+    REQUIRE(profiler.snapshot().frames.empty());
+}
+
+TEST_CASE("Trace events", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b00111111,
+/*0x0002*/    SET_CODE,  0b00101111,
+/*0x0004*/    SET_CODE,  0b00011111,
+/*0x0006*/    SET_CODE,  0b00001111,
+/*0x0008*/    SET_CODE,  0b01001010,
+/*0x000a*/    DEC_CODE,  0b00000000,
+/*0x000c*/    BRNZ_CODE, 0b00000100,
+/*0x000e*/    SELB_CODE, 0b00000001,
+/*0x0010*/    LDI_CODE,  0b00000000,
+/*0x0012*/    0x7d,      0x14,
+/*0x0014*/    LDI_CODE,  0b00000001,
+/*0x0016*/    0x00,      0x40,
+/*0x0018*/    ST_CODE,   0b00000001,
+/*0x001a*/    0x3f,      0b00000000,
+/*0x001c*/    HLT_CODE,  0b00000000,
+    };
+    // Returns past the illegal instruction
+    auto const trap_handler = std::array<Byte, 8>{
+/*0x0040*/    POP_CODE,  0b00000010,
+/*0x0042*/    ADDI_CODE, 0b10000010,
+/*0x0044*/    PUSH_CODE, 0b00000010,
+/*0x0046*/    RETI_CODE, 0b00000000,
+    };
+    std::copy(trap_handler.begin(), trap_handler.end(), code.begin() + 0x40);
+
+    TraceEvents::enable();
+    {
+        Micro16 mcu{code};
+        TraceEventsProbe probe;
+        mcu.run(probe);
+        probe.end_slice();
+    }
+    TraceEvents::disable();
+    TraceEvents::instant("not recorded");
+
+    auto json = std::stringstream{};
+    TraceEvents::write_json(json);
+    auto text = json.str();
+    REQUIRE(text.find("{\"traceEvents\": [") == 0);
+    REQUIRE(text.find("\"name\": \"run\", \"ph\": \"X\"") != std::string::npos);
+    REQUIRE(text.find("\"args\": {\"instructions\": 100000}") != std::string::npos);
+    REQUIRE(text.find("\"args\": {\"instructions\": 31085}") != std::string::npos);
+    REQUIRE(text.find("\"name\": \"interrupt handler\", \"ph\": \"B\"") != std::string::npos);
+    REQUIRE(text.find("\"args\": {\"address\": 64}") != std::string::npos);
+    REQUIRE(text.find("\"name\": \"interrupt handler\", \"ph\": \"E\"") != std::string::npos);
+    REQUIRE(text.find("\"name\": \"timer tick\"") != std::string::npos);
+    REQUIRE(text.find("\"args\": {\"name\": \"timer1\"}") != std::string::npos);
+    REQUIRE(text.find("not recorded") == std::string::npos);
+}
+
+TEST_CASE("Latency histogram", MICRO16_INSTRUMENTATION_TAG) {
+    LatencyHistogram histogram;
+    REQUIRE(histogram.percentile(50) == 0ns);
+
+    for (int i = 1; i <= 1000; ++i) {
+        histogram.record(std::chrono::microseconds{i});
+    }
+    REQUIRE(histogram.get_count() == 1000);
+    REQUIRE(histogram.get_max() == 1000us);
+    auto p50 = histogram.percentile(50).count();
+    auto p99 = histogram.percentile(99).count();
+    REQUIRE(p50 <= 500000);
+    REQUIRE(p50 >= 500000 * 0.97);
+    REQUIRE(p99 <= 990000);
+    REQUIRE(p99 >= 990000 * 0.97);
+    REQUIRE(histogram.percentile(100) <= 1000us);
+
+    for (auto ns : {uint64_t{0}, uint64_t{63}, uint64_t{64}, uint64_t{1000}, uint64_t{123456789}}) {
+        auto bucket = LatencyHistogram::bucket_of(ns);
+        REQUIRE(LatencyHistogram::lowest_value_of(bucket) <= ns);
+        REQUIRE(LatencyHistogram::lowest_value_of(bucket + 1) > ns);
+    }
+}
+
+TEST_CASE("Runtime statistics", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    ETI_CODE,  0b00000000,
+/*0x0002*/    EAI_CODE,  0b00000000,
+/*0x0004*/    BRK_CODE,  0b00000000,
+/*0x0006*/    HLT_CODE,  0b00000000,
+    };
+
+    // The interrupt table is empty, so the timer interrupt handler starts back at 0x0000
+    Micro16 mcu{code};
+    auto n_breakpoints = 0;
+    mcu.set_breakpoint_handler([&]() {
+        if (n_breakpoints++ == 0) {
+            mcu.raise_interrupt(TIMER0_INTERRUPT);
+        }
+    });
+    mcu.run();
+
+    REQUIRE(mcu.get_instruction_count() >= 7);
+    REQUIRE(mcu.get_timer_interrupt_latency().get_count() >= 1);
+}
+
+TEST_CASE("Address breakpoints and watchpoints", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b00010001,
+/*0x0002*/    SET_CODE,  0b01000101,
+/*0x0004*/    ST_CODE,   0b00000001,
+/*0x0006*/    LD_CODE,   0b00000010,
+/*0x0008*/    INC_CODE,  0b00000010,
+/*0x000a*/    HLT_CODE,  0b00000000,
+    };
+
+    Micro16 mcu{code};
+    auto breakpoints = std::vector<Micro16::InternalState>{};
+    mcu.set_address_breakpoint_handler([&](Micro16::InternalState const& state, MemoryBus const& memory) {
+        REQUIRE(memory.bank(2)[0x0011] == 0x05);
+        breakpoints.push_back(state);
+        mcu.remove_breakpoint(state.IP);
+    });
+    auto accesses = std::vector<std::pair<Address, Micro16::MemoryAccess>>{};
+    mcu.set_watchpoint_handler([&](Micro16::InternalState const& state, MemoryBus const& memory, Micro16::MemoryAccess const& access) {
+        accesses.emplace_back(state.IP, access);
+    });
+    mcu.add_breakpoint(0x0008);
+    mcu.add_watchpoint(2, 0x0011, 1, DebugPoints::READ | DebugPoints::WRITE);
+    mcu.add_watchpoint(1, 0x0011, 1, DebugPoints::READ | DebugPoints::WRITE);
+    mcu.run();
+
+    REQUIRE(breakpoints.size() == 1);
+    REQUIRE(breakpoints[0] == Micro16::InternalState{true, 0x0008, 0x9000, 0x8000, 0x0010, 0x0005, 0x0005, 0x0000});
+    REQUIRE(accesses.size() == 2);
+    REQUIRE(accesses[0].first == 0x0004);
+    REQUIRE(accesses[0].second.type == DebugPoints::WRITE);
+    REQUIRE(accesses[0].second.bank_id == 2);
+    REQUIRE(accesses[0].second.addr == 0x0010);
+    REQUIRE(accesses[0].second.value == 0x0005);
+    REQUIRE(accesses[1].first == 0x0006);
+    REQUIRE(accesses[1].second.type == DebugPoints::READ);
+    REQUIRE(mcu.get_state().W2 == 0x0006);
+}
+
+TEST_CASE("Rewind to a previous instruction", MICRO16_INSTRUMENTATION_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    SET_CODE,  0b11000100,
+/*0x0002*/    SET_CODE,  0b10110001,
+/*0x0004*/    ST_CODE,   0b00000000,
+/*0x0006*/    INC_CODE,  0b00000000,
+/*0x0008*/    INC_CODE,  0b00000000,
+/*0x000a*/    BRNE_CODE, 0b00110010,
+/*0x000c*/    HLT_CODE,  0b00000000,
+    };
+
+    // Stops a run after a number of instructions
+    struct StopAt {
+        Micro16& mcu;
+        uint64_t instruction_count;
+
+        void on_instruction(Address, Instruction, Address)
+        {
+            if (this->mcu.get_instruction_count() == this->instruction_count) {
+                this->mcu.force_halt();
+            }
+        }
+    };
+
+    Micro16 mcu{code};
+    mcu.enable_checkpoints(1000, 4);
+    mcu.run();
+    auto final_state = mcu.get_state();
+    auto final_count = mcu.get_instruction_count();
+    REQUIRE(final_state.W0 == 0x1000);
+    // Only the pages written since each checkpoint, and the device registers, are kept
+    REQUIRE(mcu.get_checkpoints_size() < 4 * 8 * sizeof(MemoryBus::SavedPage));
+    REQUIRE_THROWS(mcu.rewind_to(3000));
+
+    for (auto instruction_count : {uint64_t{5555}, uint64_t{7001}, uint64_t{6000}}) {
+        Micro16 reference{code};
+        auto stop_at = StopAt{reference, instruction_count};
+        reference.run(stop_at);
+
+        mcu.rewind_to(instruction_count);
+        auto state = mcu.get_state();
+        auto reference_state = reference.get_state();
+        reference_state.running = true;
+        REQUIRE(mcu.get_instruction_count() == instruction_count);
+        REQUIRE(state == reference_state);
+        auto bank = std::as_const(mcu.get_bus()).bank(2);
+        auto reference_bank = std::as_const(reference.get_bus()).bank(2);
+        REQUIRE(std::equal(bank, bank + BANK_SIZE, reference_bank));
+    }
+
+    mcu.run();
+    REQUIRE(mcu.get_state() == final_state);
+    REQUIRE(mcu.get_instruction_count() == final_count);
+}
@@ -0,0 +1,424 @@
+#include <tests/catch.hpp>
+#include <tests/catch_extensions.hpp>
+#include <micro16.hpp>
+#include <dma.hpp>
+#include <blitter.hpp>
+#include <keyboard.hpp>
+#include <disk.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+auto constexpr MICRO16_PERIPHERALS_TAG = "[micro16 peripherals]";
+
+TEST_CASE("DMA fill and copy", MICRO16_PERIPHERALS_TAG) {
+    auto program = ProgramWriter{};
+    auto dma_register = [](Address reg) { return Address(DMA_ADDR + reg); };
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * DMA_INTERRUPT, 0x1000);
+    program.emit(EII_CODE, 0b00000001);
+    program.emit(EAI_CODE);
+
+    // Fill bank 2 [0x2000, 0x2020) with 0xab
+    program.store(dma_register(DMAController::DST_BANK), 0x0002);
+    program.store(dma_register(DMAController::DST_ADDR), 0x2000);
+    program.store(dma_register(DMAController::LENGTH), 0x0020);
+    program.store(dma_register(DMAController::FILL_VALUE), 0x00ab);
+    program.store(dma_register(DMAController::CONTROL), DMAController::CONTROL_START | DMAController::CONTROL_FILL);
+
+    // Copy bank 2 [0x2010, 0x2030) to bank 1 [0x0100, 0x0120)
+    program.store(dma_register(DMAController::SRC_BANK), 0x0002);
+    program.store(dma_register(DMAController::SRC_ADDR), 0x2010);
+    program.store(dma_register(DMAController::DST_BANK), 0x0001);
+    program.store(dma_register(DMAController::DST_ADDR), 0x0100);
+    program.store(dma_register(DMAController::CONTROL), DMAController::CONTROL_START);
+    program.emit(HLT_CODE);
+
+    // Completion interrupt handler
+    program.pos = 0x1000;
+    program.emit(INC_CODE, 0b00000011);
+    program.emit(RETI_CODE);
+
+    Micro16 mcu{program.code};
+    DMAController dma{mcu};
+    mcu.register_mmio(dma, Address{DMA_ADDR}, DMAController::N_REGISTER_BYTES);
+    mcu.run();
+
+    auto& bus = mcu.get_bus();
+    REQUIRE(bus.bank(2)[0x1fff] == 0x00);
+    REQUIRE(bus.bank(2)[0x2000] == 0xab);
+    REQUIRE(bus.bank(2)[0x201f] == 0xab);
+    REQUIRE(bus.bank(2)[0x2020] == 0x00);
+    REQUIRE(bus.bank(1)[0x00ff] == 0x00);
+    REQUIRE(bus.bank(1)[0x0100] == 0xab);
+    REQUIRE(bus.bank(1)[0x010f] == 0xab);
+    REQUIRE(bus.bank(1)[0x0110] == 0x00);
+
+    // One completion interrupt per transfer
+    REQUIRE(mcu.get_state().W3 == 2);
+    REQUIRE(load_word(bus.bank(1) + DMA_ADDR + DMAController::CONTROL) == 0x0000);
+}
+
+TEST_CASE("DMA transfers into its own registers", MICRO16_PERIPHERALS_TAG) {
+    auto program = ProgramWriter{};
+    auto dma_register = [](Address reg) { return Address(DMA_ADDR + reg); };
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * DMA_INTERRUPT, 0x1000);
+    program.emit(EII_CODE, 0b00000001);
+    program.emit(EAI_CODE);
+
+    // Fills the control register with START | FILL
+    program.store(dma_register(DMAController::DST_BANK), 0x0001);
+    program.store(dma_register(DMAController::DST_ADDR), dma_register(DMAController::CONTROL));
+    program.store(dma_register(DMAController::LENGTH), 0x0002);
+    program.store(dma_register(DMAController::FILL_VALUE), 0x0003);
+    program.store(dma_register(DMAController::CONTROL), DMAController::CONTROL_START | DMAController::CONTROL_FILL);
+    program.emit(HLT_CODE);
+
+    program.pos = 0x1000;
+    program.emit(INC_CODE, 0b00000011);
+    program.emit(RETI_CODE);
+
+    Micro16 mcu{program.code};
+    DMAController dma{mcu};
+    mcu.register_mmio(dma, Address{DMA_ADDR}, DMAController::N_REGISTER_BYTES);
+    mcu.run();
+
+    REQUIRE(mcu.get_state().W3 == 1);
+    REQUIRE(load_word(mcu.get_bus().bank(1) + DMA_ADDR + DMAController::CONTROL) == 0x0302);
+}
+
+TEST_CASE("Blitter", MICRO16_PERIPHERALS_TAG) {
+    auto program = ProgramWriter{};
+    auto blitter_register = [](Address reg) { return Address(BLITTER_ADDR + reg); };
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(blitter_register(Blitter::SRC_BANK), 0x0002);
+    program.store(blitter_register(Blitter::SRC_ADDR), 0x3000);
+    program.store(blitter_register(Blitter::WIDTH), 3);
+    program.store(blitter_register(Blitter::HEIGHT), 2);
+    program.store(blitter_register(Blitter::COLOR_KEY), Blitter::COLOR_KEY_ENABLE | 0x2);
+
+    // Odd x, fully on screen
+    program.store(blitter_register(Blitter::DST_X), 1);
+    program.store(blitter_register(Blitter::DST_Y), 1);
+    program.store(blitter_register(Blitter::CONTROL), Blitter::CONTROL_START);
+
+    // Clipped by the left and bottom borders
+    program.store(blitter_register(Blitter::DST_X), 0xffff);
+    program.store(blitter_register(Blitter::DST_Y), 199);
+    program.store(blitter_register(Blitter::CONTROL), Blitter::CONTROL_START);
+    program.emit(HLT_CODE);
+
+    Micro16 mcu{program.code};
+    Blitter blitter{mcu};
+    mcu.register_mmio(blitter, Address{BLITTER_ADDR}, Blitter::N_REGISTER_BYTES);
+
+    auto& bus = mcu.get_bus();
+    auto* video = bus.bank(MMIO_BANK) + VIDEO_ADDR;
+    bus.fill(MMIO_BANK, VIDEO_ADDR, 0xff, VIDEO_WIDTH * VIDEO_HEIGHT / 2);
+
+    // 3x2 sprite. Pixels are 1 2 3 on the first row and 4 5 6 on the second.
+    auto* sprite = bus.bank(2) + 0x3000;
+    sprite[0] = 0x12;
+    sprite[1] = 0x30;
+    sprite[2] = 0x45;
+    sprite[3] = 0x60;
+
+    mcu.run();
+
+    REQUIRE(video[159] == 0xff);
+    REQUIRE(video[160] == 0xf1);
+    REQUIRE(video[161] == 0xf3);
+    REQUIRE(video[162] == 0xff);
+    REQUIRE(video[320] == 0xf4);
+    REQUIRE(video[321] == 0x56);
+    REQUIRE(video[322] == 0xff);
+
+    REQUIRE(video[199 * 160 + 0] == 0xf3);
+    REQUIRE(video[199 * 160 + 1] == 0xff);
+    REQUIRE(video[VIDEO_WIDTH * VIDEO_HEIGHT / 2] == 0x00);
+}
+
+TEST_CASE("Keyboard events", MICRO16_PERIPHERALS_TAG) {
+    auto program = ProgramWriter{};
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * KEYBOARD_INTERRUPT, 0x1000);
+    program.emit(EII_CODE, 0b00000000);
+    program.emit(EAI_CODE);
+    program.emit(BRK_CODE);
+    program.emit(HLT_CODE);
+
+    // Keyboard interrupt handler: Consumes a single event into W3
+    program.pos = 0x1000;
+    program.set_register(0, KEYBOARD_ADDR + Keyboard::EVENTS);
+    program.emit(LD_CODE, 0b00000011);
+    program.store(KEYBOARD_ADDR + Keyboard::TAIL, 1);
+    program.emit(RETI_CODE);
+
+    Micro16 mcu{program.code};
+    Keyboard keyboard{mcu};
+    mcu.register_mmio(keyboard, Address{KEYBOARD_ADDR});
+    mcu.set_breakpoint_handler([&]() {
+        REQUIRE(keyboard.push_key_event(0x04, true));
+        REQUIRE(keyboard.push_key_event(0x04, false));
+        keyboard.flush();
+    });
+    mcu.run();
+
+    auto const* input = mcu.get_bus().bank(MMIO_BANK) + KEYBOARD_ADDR;
+    REQUIRE(mcu.get_state().W3 == (Keyboard::KEY_PRESSED | 0x04));
+    REQUIRE(load_word(input + Keyboard::HEAD) == 2);
+    REQUIRE(load_word(input + Keyboard::TAIL) == 1);
+    REQUIRE(load_word(input + Keyboard::EVENTS + 2) == 0x0004);
+}
+
+TEST_CASE("Keyboard drops events when full", MICRO16_PERIPHERALS_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    HLT_CODE, 0b00000000,
+    };
+
+    Micro16 mcu{code};
+    Keyboard keyboard{mcu};
+    mcu.register_mmio(keyboard, Address{KEYBOARD_ADDR});
+    for (int i = 0; i < Keyboard::N_EVENTS - 1; ++i) {
+        REQUIRE(keyboard.push_key_event(i, true));
+    }
+    REQUIRE(!keyboard.push_key_event(0xff, true));
+    mcu.run();
+}
+
+TEST_CASE("Disk transfers", MICRO16_PERIPHERALS_TAG) {
+    auto asynchronous = GENERATE(false, true);
+
+    // 4 sectors, each filled with its sector number + 1
+    auto image_file = (std::filesystem::temp_directory_path() / "micro16_test_disk.img").string();
+    {
+        auto image = std::ofstream{image_file, std::ios::out | std::ios::binary};
+        for (int sector = 0; sector < 4; ++sector) {
+            auto data = std::string(Disk::SECTOR_SIZE, char(sector + 1));
+            image.write(data.data(), data.size());
+        }
+    }
+
+    auto program = ProgramWriter{};
+    auto disk_register = [](Address reg) { return Address(DISK_ADDR + reg); };
+    auto wait_transfer = [&]() {
+        auto loop = program.pos;
+        program.set_register(0, disk_register(Disk::STATUS));
+        program.emit(LD_CODE, 0b00000001);
+        program.set_register(2, loop);
+        program.emit(BRNZ_CODE, 0b00001001);
+    };
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * DISK_INTERRUPT, 0x1000);
+    program.emit(EII_CODE, 0b00000010);
+    program.emit(EAI_CODE);
+
+    // Read sectors 1 and 2 into bank 2
+    program.store(disk_register(Disk::SECTOR), 1);
+    program.store(disk_register(Disk::COUNT), 2);
+    program.store(disk_register(Disk::BANK), 2);
+    program.store(disk_register(Disk::ADDR), 0x4000);
+    program.store(disk_register(Disk::CONTROL), Disk::CONTROL_START);
+    wait_transfer();
+
+    // Write the second sector read back to sector 3
+    program.store(disk_register(Disk::SECTOR), 3);
+    program.store(disk_register(Disk::COUNT), 1);
+    program.store(disk_register(Disk::ADDR), 0x4000 + Disk::SECTOR_SIZE);
+    program.store(disk_register(Disk::CONTROL), Disk::CONTROL_START | Disk::CONTROL_WRITE);
+    wait_transfer();
+
+    // Out of the image
+    program.store(disk_register(Disk::SECTOR), 4);
+    program.store(disk_register(Disk::CONTROL), Disk::CONTROL_START);
+    program.emit(HLT_CODE);
+
+    // Completion interrupt handler
+    program.pos = 0x1000;
+    program.emit(INC_CODE, 0b00000011);
+    program.emit(RETI_CODE);
+
+    {
+        Micro16 mcu{program.code};
+        Disk disk{mcu, image_file, asynchronous};
+        mcu.register_mmio(disk, Address{DISK_ADDR}, Disk::N_REGISTER_BYTES);
+        REQUIRE(load_word(mcu.get_bus().bank(MMIO_BANK) + DISK_ADDR + Disk::N_SECTORS) == 4);
+        mcu.run();
+
+        auto const* bank = mcu.get_bus().bank(2);
+        REQUIRE(bank[0x3fff] == 0x00);
+        REQUIRE(bank[0x4000] == 0x02);
+        REQUIRE(bank[0x4000 + Disk::SECTOR_SIZE - 1] == 0x02);
+        REQUIRE(bank[0x4000 + Disk::SECTOR_SIZE] == 0x03);
+        REQUIRE(bank[0x4000 + 2 * Disk::SECTOR_SIZE - 1] == 0x03);
+        REQUIRE(bank[0x4000 + 2 * Disk::SECTOR_SIZE] == 0x00);
+        if (!asynchronous) {
+            REQUIRE(mcu.get_state().W3 == 3);
+            REQUIRE(load_word(mcu.get_bus().bank(MMIO_BANK) + DISK_ADDR + Disk::STATUS) == Disk::STATUS_ERROR);
+        }
+    }
+
+    auto image = std::ifstream{image_file, std::ios::in | std::ios::binary};
+    image.seekg(3 * Disk::SECTOR_SIZE);
+    REQUIRE(image.get() == 0x03);
+    image.seekg(4 * Disk::SECTOR_SIZE - 1);
+    REQUIRE(image.get() == 0x03);
+    image.close();
+    std::filesystem::remove(image_file);
+}
+
+TEST_CASE("Disk reads into its own registers", MICRO16_PERIPHERALS_TAG) {
+    auto asynchronous = GENERATE(false, true);
+
+    // A sector that would start a transfer if read into the control register
+    auto image_file = (std::filesystem::temp_directory_path() / "micro16_test_registers_disk.img").string();
+    {
+        auto sector = std::string(Disk::SECTOR_SIZE, char(0x00));
+        sector[1] = char(Disk::CONTROL_START);
+        auto image = std::ofstream{image_file, std::ios::out | std::ios::binary};
+        image.write(sector.data(), sector.size());
+    }
+
+    auto program = ProgramWriter{};
+    auto disk_register = [](Address reg) { return Address(DISK_ADDR + reg); };
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * DISK_INTERRUPT, 0x1000);
+    program.emit(EII_CODE, 0b00000010);
+    program.emit(EAI_CODE);
+    program.store(disk_register(Disk::SECTOR), 0);
+    program.store(disk_register(Disk::COUNT), 1);
+    program.store(disk_register(Disk::BANK), MMIO_BANK);
+    program.store(disk_register(Disk::ADDR), disk_register(Disk::CONTROL));
+    program.store(disk_register(Disk::CONTROL), Disk::CONTROL_START);
+    program.emit(HLT_CODE);
+
+    program.pos = 0x1000;
+    program.emit(INC_CODE, 0b00000011);
+    program.emit(RETI_CODE);
+
+    {
+        Micro16 mcu{program.code};
+        Disk disk{mcu, image_file, asynchronous};
+        mcu.register_mmio(disk, Address{DISK_ADDR}, Disk::N_REGISTER_BYTES);
+        mcu.run();
+
+        REQUIRE(mcu.get_state().W3 == 1);
+        REQUIRE(load_word(mcu.get_bus().bank(MMIO_BANK) + DISK_ADDR + Disk::STATUS) == Disk::STATUS_ERROR);
+        REQUIRE(load_word(mcu.get_bus().bank(MMIO_BANK) + DISK_ADDR + Disk::N_SECTORS) == 1);
+    }
+    std::filesystem::remove(image_file);
+}
+
+TEST_CASE("Asynchronous disk reads into a shared code bank", MICRO16_PERIPHERALS_TAG) {
+    // A sector with code, loaded into the code bank and run
+    auto image_file = (std::filesystem::temp_directory_path() / "micro16_test_code_disk.img").string();
+    {
+        auto sector = std::string(Disk::SECTOR_SIZE, char(0x00));
+        sector[0] = char(INC_CODE);
+        sector[1] = char(0b00000011);
+        sector[2] = char(HLT_CODE);
+        auto image = std::ofstream{image_file, std::ios::out | std::ios::binary};
+        image.write(sector.data(), sector.size());
+    }
+
+    auto program = ProgramWriter{};
+    auto disk_register = [](Address reg) { return Address(DISK_ADDR + reg); };
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(disk_register(Disk::SECTOR), 0);
+    program.store(disk_register(Disk::COUNT), 1);
+    program.store(disk_register(Disk::BANK), CODE_BANK);
+    program.store(disk_register(Disk::ADDR), 0x8000);
+    program.store(disk_register(Disk::CONTROL), Disk::CONTROL_START);
+    auto loop = program.pos;
+    program.set_register(0, disk_register(Disk::STATUS));
+    program.emit(LD_CODE, 0b00000001);
+    program.set_register(2, loop);
+    program.emit(BRNZ_CODE, 0b00001001);
+    program.set_register(0, 0x8000);
+    program.emit(JMP_CODE, 0b00000000);
+
+    auto code = std::make_shared<MemoryBus::Bank const>(program.code);
+    {
+        Micro16 mcu{code};
+        Disk disk{mcu, image_file, true};
+        mcu.register_mmio(disk, Address{DISK_ADDR}, Disk::N_REGISTER_BYTES);
+        mcu.run();
+
+        REQUIRE(!mcu.get_bus().is_shared(CODE_BANK));
+        REQUIRE(mcu.get_state().IP == 0x8004);
+        REQUIRE(mcu.get_state().W3 == 1);
+    }
+    REQUIRE((*code)[0x8000] == 0x00);
+    std::filesystem::remove(image_file);
+}
+
+TEST_CASE("Record and replay inputs", MICRO16_PERIPHERALS_TAG) {
+    auto program = ProgramWriter{};
+
+    program.emit(SELB_CODE, 0b00000001);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * TIMER0_INTERRUPT, 0x1000);
+    program.store(IT_ADDR + IT_ENTRY_SIZE * KEYBOARD_INTERRUPT, 0x1100);
+    program.emit(ETI_CODE, 0b00000000);
+    program.emit(EII_CODE, 0b00000000);
+    program.emit(EAI_CODE);
+    program.emit(CLR_CODE, 0b00000001);
+    program.set_register(3, program.pos + 8);
+    // Counts in W2 until halted from outside
+    program.emit(INC_CODE, 0b00000010);
+    program.emit(JMP_CODE, 0b00000011);
+
+    // Timer 0 interrupt handler: Counts ticks in W1
+    program.pos = 0x1000;
+    program.emit(INC_CODE, 0b00000001);
+    program.emit(RETI_CODE);
+
+    // Keyboard interrupt handler: Reads the first event into W0
+    program.pos = 0x1100;
+    program.set_register(0, KEYBOARD_ADDR + Keyboard::EVENTS);
+    program.emit(LD_CODE, 0b00000000);
+    program.emit(RETI_CODE);
+
+    auto log = InputLog{};
+    auto recorded_state = Micro16::InternalState{};
+    auto recorded_count = uint64_t{0};
+    {
+        Micro16 mcu{program.code};
+        Keyboard keyboard{mcu};
+        mcu.register_mmio(keyboard, Address{KEYBOARD_ADDR});
+        mcu.record_inputs(log);
+        auto runner = std::thread{[&mcu]() { mcu.run(); }};
+        std::this_thread::sleep_for(120ms);
+        REQUIRE(keyboard.push_key_event(0x04, true));
+        keyboard.flush();
+        std::this_thread::sleep_for(30ms);
+        mcu.force_halt();
+        runner.join();
+        recorded_state = mcu.get_state();
+        recorded_count = mcu.get_instruction_count();
+    }
+
+    REQUIRE(recorded_state.W0 == (Keyboard::KEY_PRESSED | 0x04));
+    REQUIRE(recorded_state.W1 >= 1);
+    REQUIRE(log.entries.back() == InputLog::Entry{recorded_count, InputLog::Type::HALT, 0});
+
+    // Through the file format
+    auto log_file = std::stringstream{};
+    log.write(log_file);
+    auto replayed_log = InputLog::read(log_file);
+    REQUIRE(replayed_log.entries == log.entries);
+
+    Micro16 mcu{program.code};
+    Keyboard keyboard{mcu};
+    mcu.register_mmio(keyboard, Address{KEYBOARD_ADDR});
+    mcu.replay_inputs(replayed_log);
+    mcu.run();
+    REQUIRE(mcu.get_state() == recorded_state);
+    REQUIRE(mcu.get_instruction_count() == recorded_count);
+}
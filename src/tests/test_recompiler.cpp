@@ -0,0 +1,124 @@
+#include <tests/catch.hpp>
+#include <tests/catch_extensions.hpp>
+#include <recomp/recompiler.hpp>
+#include <recomp/runtime.hpp>
+#include <micro16.hpp>
+#include <isa.h>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+auto constexpr MICRO16_RECOMPILER_TAG = "[micro16 recompiler]";
+
+// Generated at build time by micro16_recomp, from test_recompiler/differential.m16asm
+void load_recompiled_code(Micro16State& s);
+void run_recompiled(Micro16State& s);
+
+TEST_CASE("Recompiler basic blocks", MICRO16_RECOMPILER_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    CLR_CODE,  0b00000001,
+/*0x0002*/    SET_CODE,  0b01001100,
+/*0x0004*/    CALL_CODE, 0b00000001,
+/*0x0006*/    HLT_CODE,  0b00000000,
+/*0x0008*/    NOP_CODE,  0b00000000,
+/*0x000a*/    NOP_CODE,  0b00000000,
+/*0x000c*/    INC_CODE,  0b00000000,
+/*0x000e*/    RET_CODE,  0b00000000,
+    };
+
+    auto recompiler = Recompiler{code};
+    auto blocks = recompiler.get_blocks();
+    REQUIRE(blocks.size() == 3);
+    REQUIRE(blocks[0].start == 0x0000);
+    REQUIRE(blocks[0].end == 0x0004);
+    REQUIRE(blocks[1].start == 0x0006);
+    REQUIRE(blocks[1].end == 0x0006);
+    REQUIRE(blocks[2].start == 0x000c);
+    REQUIRE(blocks[2].end == 0x000e);
+
+    auto cpp = std::stringstream{};
+    recompiler.write_cpp(cpp, false);
+    auto text = cpp.str();
+    REQUIRE(text.find("void block_0x000c(Micro16State& s)") != std::string::npos);
+    REQUIRE(text.find("case 0x0006: block_0x0006(s); break;") != std::string::npos);
+    REQUIRE(text.find("s.write_word(s.stack_bank(), s.SP, 0x0006); s.IP = s.W[1]; return;") != std::string::npos);
+    REQUIRE(text.find("int main()") == std::string::npos);
+}
+
+TEST_CASE("Recompiler stops blocks before unknown instructions", MICRO16_RECOMPILER_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    INC_CODE,  0b00000000,
+/*0x0002*/    0x3f,      0b00000000,
+/*0x0004*/    HLT_CODE,  0b00000000,
+    };
+
+    auto recompiler = Recompiler{code};
+    auto blocks = recompiler.get_blocks();
+    REQUIRE(blocks.size() == 1);
+    REQUIRE(blocks[0].end == 0x0000);
+
+    auto cpp = std::stringstream{};
+    recompiler.write_cpp(cpp);
+    REQUIRE(cpp.str().find("default: step(s); break;") != std::string::npos);
+    REQUIRE(cpp.str().find("IT_ADDR + IT_ENTRY_SIZE * ILLEGAL_INSTRUCTION_INTERRUPT") != std::string::npos);
+}
+
+TEST_CASE("Recompiler follows immediate loads", MICRO16_RECOMPILER_TAG) {
+    auto code = std::array<Byte, BANK_SIZE>{
+/*0x0000*/    LDI_CODE,  0b00000001,
+/*0x0002*/    0x00,      0x0a,
+/*0x0004*/    ADDI_CODE, 0b01000010,
+/*0x0006*/    JMP_CODE,  0b00000001,
+/*0x0008*/    HLT_CODE,  0b00000000,
+/*0x000a*/    NOP_CODE,  0b00000000,
+/*0x000c*/    HLT_CODE,  0b00000000,
+    };
+
+    auto recompiler = Recompiler{code};
+    auto blocks = recompiler.get_blocks();
+    REQUIRE(blocks.size() == 3);
+    REQUIRE(blocks[0].start == 0x0000);
+    REQUIRE(blocks[0].end == 0x0006);
+    REQUIRE(blocks[1].start == 0x000a);
+    REQUIRE(blocks[2].start == 0x000c);
+
+    auto cpp = std::stringstream{};
+    recompiler.write_cpp(cpp, false);
+    auto text = cpp.str();
+    REQUIRE(text.find("s.W[1] = 0x000a;") != std::string::npos);
+    REQUIRE(text.find("s.W[1] += (2 ^ 0x20) - 0x20;") != std::string::npos);
+}
+
+TEST_CASE("Recompiler walks code filling the whole bank", MICRO16_RECOMPILER_TAG) {
+    // All ADD W0 W0 W1, with no flow instruction to stop at
+    auto code = std::array<Byte, BANK_SIZE>{};
+    code.fill(0x01);
+
+    auto recompiler = Recompiler{code};
+    auto blocks = recompiler.get_blocks();
+    REQUIRE(blocks.size() == 1);
+    REQUIRE(blocks[0].start == 0x0000);
+    REQUIRE(blocks[0].end == 0xfffe);
+}
+
+TEST_CASE("Recompiled code ends in the same state as the interpreter", MICRO16_RECOMPILER_TAG) {
+    auto recompiled = std::make_unique<Micro16State>();
+    load_recompiled_code(*recompiled);
+    Micro16 mcu{recompiled->banks[CODE_BANK]};
+    run_recompiled(*recompiled);
+    mcu.run();
+
+    REQUIRE(mcu.get_exit_reason() == Micro16::ExitReason::HALT);
+    auto const& W = recompiled->W;
+    REQUIRE(mcu.get_state() == Micro16::InternalState{recompiled->running, recompiled->IP, recompiled->CR, recompiled->SP, W[0], W[1], W[2], W[3]});
+    for (int bank_id = 0; bank_id < N_BANKS; ++bank_id) {
+        auto const& bank = recompiled->banks[bank_id];
+        REQUIRE(std::equal(bank.begin(), bank.end(), std::as_const(mcu.get_bus()).bank(bank_id)));
+    }
+
+    // 32 bits sum of i * 0x1234 for i in 1..40
+    auto const* data = std::as_const(mcu.get_bus()).bank(2);
+    REQUIRE(load_word(data + 0x0100) == 0x4e90);
+    REQUIRE(load_word(data + 0x0102) == 0x003a);
+}
@@ -0,0 +1,256 @@
+#include <trace.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    using TracedRegisters = std::array<Register, TraceRecord::N_TRACED_REGISTERS>;
+
+    constexpr auto MAGIC_SIZE = sizeof(TraceCodec::MAGIC) - 1;
+
+    Byte* put_word(Byte* out, Register value)
+    {
+        store_word(out, value);
+        return out + 2;
+    }
+
+    bool get_byte(std::istream& is, Byte& value)
+    {
+        auto c = is.get();
+        value = Byte(c);
+        return c != std::char_traits<char>::eof();
+    }
+
+    bool get_word(std::istream& is, Register& value)
+    {
+        auto high = Byte{0};
+        auto low = Byte{0};
+        if (!get_byte(is, high) || !get_byte(is, low)) {
+            return false;
+        }
+        value = (high << 8) | low;
+        return true;
+    }
+
+    bool fits_in_signed_byte(int delta)
+    {
+        return delta >= -128 && delta <= 127;
+    }
+
+    TracedRegisters read_header(std::istream& is, std::string const& trace_file)
+    {
+        if (is.fail()) {
+            throw std::runtime_error("Could not open file " + trace_file);
+        }
+        char magic[MAGIC_SIZE];
+        is.read(magic, MAGIC_SIZE);
+        if (is.gcount() != MAGIC_SIZE || std::memcmp(magic, TraceCodec::MAGIC, MAGIC_SIZE) != 0) {
+            throw std::runtime_error("Not a micro16 trace file: " + trace_file);
+        }
+        auto registers = TracedRegisters{};
+        for (auto& r : registers) {
+            if (!get_word(is, r)) {
+                throw std::runtime_error("Truncated micro16 trace file: " + trace_file);
+            }
+        }
+        return registers;
+    }
+}
+
+std::string traced_register_name(Byte traced_register)
+{
+    switch (traced_register) {
+        case TraceRecord::REG_SP: return "SP";
+        case TraceRecord::REG_CR: return "CR";
+        case TraceRecord::NO_REGISTER: return "";
+        default: return "W" + std::to_string(traced_register);
+    }
+}
+
+TraceCodec::TraceCodec(TracedRegisters const& registers)
+    : registers(registers)
+    , expected_IP(0)
+    , instructions(BANK_SIZE, UNKNOWN_INSTRUCTION)
+{
+}
+
+Byte* TraceCodec::encode(TraceRecord const& record, Byte* out)
+{
+    auto header = Byte{0};
+    auto header_pos = out++;
+
+    auto IP_delta = int(record.IP) - int(this->expected_IP);
+    if (IP_delta == 0) {
+        header |= IP_SEQUENTIAL;
+    } else if (fits_in_signed_byte(IP_delta)) {
+        header |= IP_DELTA;
+        *out++ = Byte(IP_delta);
+    } else {
+        header |= IP_ABSOLUTE;
+        out = put_word(out, record.IP);
+    }
+    this->expected_IP = record.IP + 2;
+
+    if (this->instructions[record.IP] != record.instruction) {
+        header |= HAS_INSTRUCTION;
+        out = put_word(out, record.instruction);
+        this->instructions[record.IP] = record.instruction;
+    }
+
+    header |= record.changed_register << REGISTER_SHIFT;
+    if (record.changed_register != TraceRecord::NO_REGISTER) {
+        auto& previous = this->registers[record.changed_register];
+        auto value_delta = int(record.value) - int(previous);
+        if (fits_in_signed_byte(value_delta)) {
+            header |= VALUE_DELTA;
+            *out++ = Byte(value_delta);
+        } else {
+            out = put_word(out, record.value);
+        }
+        previous = record.value;
+    }
+
+    *header_pos = header;
+    return out;
+}
+
+bool TraceCodec::decode(std::istream& is, TraceRecord& record)
+{
+    auto header = Byte{0};
+    if (!get_byte(is, header)) {
+        return false;
+    }
+
+    auto truncated = false;
+    switch (header & IP_MODE_MASK) {
+        case IP_SEQUENTIAL:
+            record.IP = this->expected_IP;
+            break;
+        case IP_DELTA: {
+            auto delta = Byte{0};
+            truncated |= !get_byte(is, delta);
+            record.IP = this->expected_IP + int8_t(delta);
+            break;
+        }
+        default:
+            truncated |= !get_word(is, record.IP);
+            break;
+    }
+    this->expected_IP = record.IP + 2;
+
+    if (header & HAS_INSTRUCTION) {
+        truncated |= !get_word(is, record.instruction);
+        this->instructions[record.IP] = record.instruction;
+    } else {
+        record.instruction = Instruction(this->instructions[record.IP]);
+    }
+
+    record.changed_register = (header >> REGISTER_SHIFT) & 0x07;
+    record.value = 0;
+    if (record.changed_register != TraceRecord::NO_REGISTER) {
+        if (record.changed_register >= TraceRecord::N_TRACED_REGISTERS) {
+            throw std::runtime_error("Corrupted micro16 trace: unknown register");
+        }
+        auto& previous = this->registers[record.changed_register];
+        if (header & VALUE_DELTA) {
+            auto delta = Byte{0};
+            truncated |= !get_byte(is, delta);
+            record.value = previous + int8_t(delta);
+        } else {
+            truncated |= !get_word(is, record.value);
+        }
+        previous = record.value;
+    }
+
+    if (truncated) {
+        throw std::runtime_error("Truncated micro16 trace");
+    }
+    return true;
+}
+
+TraceRecorder::TraceRecorder(Micro16 const& mcu, std::string const& trace_file)
+    : mcu(mcu)
+    , last_registers{}
+    , ring(RING_SIZE)
+    , head(0)
+    , tail(0)
+    , stopping(false)
+    , out(trace_file, std::ios::out | std::ios::binary)
+    , codec(TracedRegisters{})
+{
+    if (this->out.fail()) {
+        throw std::runtime_error("Could not open file " + trace_file);
+    }
+    auto state = mcu.get_state();
+    this->last_registers = {state.W0, state.W1, state.W2, state.W3, state.SP, state.CR};
+    this->codec.registers = this->last_registers;
+
+    auto header = std::array<Byte, MAGIC_SIZE + 2 * TraceRecord::N_TRACED_REGISTERS>{};
+    auto header_end = std::copy(TraceCodec::MAGIC, TraceCodec::MAGIC + MAGIC_SIZE, header.begin());
+    for (auto r : this->last_registers) {
+        header_end = put_word(header_end, r);
+    }
+    this->out.write(reinterpret_cast<char const*>(header.data()), header.size());
+
+    this->flusher_thread = std::thread{TraceRecorder::flusher, this};
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    this->finish();
+}
+
+void TraceRecorder::finish()
+{
+    this->stopping = true;
+    this->flush_condition.notify_one();
+    if (this->flusher_thread.joinable()) {
+        this->flusher_thread.join();
+        this->out.close();
+    }
+}
+
+void TraceRecorder::flusher(TraceRecorder* self)
+{
+    auto encoded = std::vector<Byte>(RING_SIZE * TraceCodec::MAX_RECORD_SIZE);
+    while (true) {
+        // Read `stopping` first, so nothing pushed before it was set is missed
+        auto stopping = self->stopping.load();
+        auto tail = self->tail.load(std::memory_order_relaxed);
+        auto head = self->head.load(std::memory_order_acquire);
+        if (head == tail && stopping) {
+            break;
+        }
+        if (head - tail < FLUSH_BATCH && !stopping) {
+            auto lock = std::unique_lock{self->flush_mutex};
+            self->flush_condition.wait_for(lock, 10ms);
+            continue;
+        }
+
+        auto encoded_end = encoded.data();
+        for (auto i = tail; i != head; ++i) {
+            encoded_end = self->codec.encode(self->ring[i % RING_SIZE], encoded_end);
+        }
+        self->tail.store(head, std::memory_order_release);
+        self->tail.notify_one();
+        self->out.write(reinterpret_cast<char const*>(encoded.data()), encoded_end - encoded.data());
+    }
+    self->out.flush();
+}
+
+TraceReader::TraceReader(std::string const& trace_file)
+    : in(trace_file, std::ios::in | std::ios::binary)
+    , initial_registers(read_header(this->in, trace_file))
+    , codec(this->initial_registers)
+{
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+    return this->codec.decode(this->in, record);
+}
+
+std::array<Register, TraceRecord::N_TRACED_REGISTERS> const& TraceReader::get_initial_registers() const
+{
+    return this->initial_registers;
+}
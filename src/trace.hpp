@@ -0,0 +1,137 @@
+#ifndef MICRO16_TRACE_HPP
+#define MICRO16_TRACE_HPP
+
+#include <micro16.hpp>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One executed instruction, and the first register it changed (if any).
+struct TraceRecord {
+    static constexpr Byte REG_SP = 4;
+    static constexpr Byte REG_CR = 5;
+    static constexpr Byte NO_REGISTER = 7;
+    static constexpr auto N_TRACED_REGISTERS = 6;
+
+    Address IP;
+    Instruction instruction;
+    Byte changed_register;
+    Register value;
+};
+
+std::string traced_register_name(Byte traced_register);
+
+// Encoder/decoder state shared by TraceRecorder and TraceReader.
+//
+// File format: "M16TRACE", the initial W0-W3, SP and CR as big endian words,
+// then one record per instruction, starting with a header byte:
+//     bits 0-1: IP mode. 0: previous IP + 2, 1: signed byte delta from it, 2: absolute word
+//     bit 2:    instruction word follows (otherwise, same as last seen at this IP)
+//     bits 3-5: changed register (TraceRecord::NO_REGISTER if none)
+//     bit 6:    value is a signed byte delta from its previous value (otherwise, absolute word)
+class TraceCodec {
+public:
+    static constexpr char MAGIC[] = "M16TRACE";
+    static constexpr Byte IP_SEQUENTIAL = 0;
+    static constexpr Byte IP_DELTA = 1;
+    static constexpr Byte IP_ABSOLUTE = 2;
+    static constexpr Byte IP_MODE_MASK = 0x03;
+    static constexpr Byte HAS_INSTRUCTION = 0x04;
+    static constexpr Byte REGISTER_SHIFT = 3;
+    static constexpr Byte VALUE_DELTA = 0x40;
+    static constexpr auto MAX_RECORD_SIZE = 7;
+
+    explicit TraceCodec(std::array<Register, TraceRecord::N_TRACED_REGISTERS> const& registers);
+
+    // Writes at most MAX_RECORD_SIZE bytes into `out`, and returns where it stopped
+    Byte* encode(TraceRecord const& record, Byte* out);
+    bool decode(std::istream& is, TraceRecord& record);
+
+    std::array<Register, TraceRecord::N_TRACED_REGISTERS> registers;
+
+private:
+    static constexpr auto UNKNOWN_INSTRUCTION = uint32_t{0xffffffff};
+
+    Address expected_IP;
+    std::vector<uint32_t> instructions;
+};
+
+// Records every executed instruction into a file. Use it as a probe on
+// Micro16::run(recorder), from a single thread: the CPU thread is the only
+// producer of its ring buffer, and a background thread encodes and writes it.
+class TraceRecorder {
+public:
+    static constexpr auto RING_SIZE = std::size_t{1} << 16;
+    // The background thread is woken up each time this number of records is pushed
+    static constexpr auto FLUSH_BATCH = RING_SIZE / 4;
+
+    TraceRecorder(Micro16 const& mcu, std::string const& trace_file);
+    ~TraceRecorder();
+
+    inline void on_instruction(Address IP, Instruction instruction, Address next_IP)
+    {
+        auto state = this->mcu.get_state();
+        auto const current = std::array<Register, TraceRecord::N_TRACED_REGISTERS>{
+            state.W0, state.W1, state.W2, state.W3, state.SP, state.CR
+        };
+        auto record = TraceRecord{IP, instruction, TraceRecord::NO_REGISTER, 0};
+        for (int i = 0; i < TraceRecord::N_TRACED_REGISTERS; ++i) {
+            if (current[i] != this->last_registers[i] && record.changed_register == TraceRecord::NO_REGISTER) {
+                record.changed_register = Byte(i);
+                record.value = current[i];
+            }
+        }
+        this->last_registers = current;
+
+        auto head = this->head.load(std::memory_order_relaxed);
+        auto tail = this->tail.load(std::memory_order_acquire);
+        if (head - tail == RING_SIZE) {
+            this->flush_condition.notify_one();
+            this->tail.wait(tail, std::memory_order_acquire);
+        }
+        this->ring[head % RING_SIZE] = record;
+        this->head.store(head + 1, std::memory_order_release);
+        if ((head + 1) % FLUSH_BATCH == 0) {
+            this->flush_condition.notify_one();
+        }
+    }
+
+    // Writes all pending records and closes the file. Called by the destructor.
+    void finish();
+
+private:
+    static void flusher(TraceRecorder* self);
+
+    Micro16 const& mcu;
+    std::array<Register, TraceRecord::N_TRACED_REGISTERS> last_registers;
+    std::vector<TraceRecord> ring;
+    std::atomic<std::size_t> head;
+    std::atomic<std::size_t> tail;
+    std::atomic<bool> stopping;
+    std::mutex flush_mutex;
+    std::condition_variable flush_condition;
+    std::ofstream out;
+    TraceCodec codec;
+    std::thread flusher_thread;
+};
+
+class TraceReader {
+public:
+    explicit TraceReader(std::string const& trace_file);
+
+    // Reads the next record. Returns false at the end of the trace.
+    bool next(TraceRecord& record);
+
+    // Registers right before the first traced instruction
+    std::array<Register, TraceRecord::N_TRACED_REGISTERS> const& get_initial_registers() const;
+
+private:
+    std::ifstream in;
+    std::array<Register, TraceRecord::N_TRACED_REGISTERS> initial_registers;
+    TraceCodec codec;
+};
+
+#endif //MICRO16_TRACE_HPP
@@ -0,0 +1,164 @@
+#include <trace.hpp>
+#include <assembler/debug_info.hpp>
+#include <argparse.hpp>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+    Address parse_address(argparse::ArgumentParser const& arg_parser, std::string const& option)
+    {
+        auto text = arg_parser.get<std::string>(option);
+        try {
+            return Address(std::stoi(text, nullptr, 0));
+        } catch (std::logic_error&) {
+            throw std::runtime_error("Invalid address for " + option + ": " + text);
+        }
+    }
+
+    std::ostream& hex_word(std::ostream& os, Register value)
+    {
+        return os << "0x" << std::setw(4) << std::setfill('0') << std::hex << value << std::dec << std::setfill(' ');
+    }
+
+    std::string location_of(std::optional<DebugInfo> const& debug_info, Address addr)
+    {
+        if (!debug_info) {
+            return "";
+        }
+        return debug_info->symbolize(addr) + " " + debug_info->describe(addr);
+    }
+
+    void print_record(std::ostream& os, uint64_t index, TraceRecord const& record, std::optional<DebugInfo> const& debug_info)
+    {
+        os << std::setw(10) << index << "  ";
+        hex_word(os, record.IP) << "  ";
+        hex_word(os, record.instruction);
+        if (record.changed_register != TraceRecord::NO_REGISTER) {
+            os << "  " << std::setw(2) << traced_register_name(record.changed_register) << " = ";
+            hex_word(os, record.value);
+        } else {
+            os << std::setw(13) << "";
+        }
+        os << "  " << location_of(debug_info, record.IP) << "\n";
+    }
+
+    struct Summary {
+        uint64_t n_records = 0;
+        uint64_t n_branches = 0;
+        std::map<Address, uint64_t> executions;
+        std::map<std::string, uint64_t> register_writes;
+        std::optional<Address> previous_IP;
+
+        void add(TraceRecord const& record)
+        {
+            this->n_records += 1;
+            if (this->previous_IP && Address(*this->previous_IP + 2) != record.IP) {
+                this->n_branches += 1;
+            }
+            this->previous_IP = record.IP;
+            this->executions[record.IP] += 1;
+            if (record.changed_register != TraceRecord::NO_REGISTER) {
+                this->register_writes[traced_register_name(record.changed_register)] += 1;
+            }
+        }
+
+        void print(std::ostream& os, std::optional<DebugInfo> const& debug_info, std::size_t n_entries) const
+        {
+            os << "Records: " << this->n_records << "\n";
+            os << "Non sequential IPs: " << this->n_branches << "\n";
+            os << "Distinct addresses: " << this->executions.size() << "\n";
+            os << "\nRegister writes:\n";
+            for (auto&& [name, count] : this->register_writes) {
+                os << "  " << std::setw(4) << std::left << name << std::right << count << "\n";
+            }
+            auto hottest = std::vector<std::pair<Address, uint64_t>>{this->executions.begin(), this->executions.end()};
+            std::stable_sort(hottest.begin(), hottest.end(), [](auto const& a, auto const& b) {
+                return a.second > b.second;
+            });
+            hottest.resize(std::min(hottest.size(), n_entries));
+            os << "\nHottest addresses:\n";
+            for (auto&& [addr, count] : hottest) {
+                os << "  ";
+                hex_word(os, addr) << "  " << std::setw(12) << count << "  " << location_of(debug_info, addr) << "\n";
+            }
+        }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    argparse::ArgumentParser arg_parser("micro16_trace");
+    arg_parser.add_argument("trace_file")
+        .help("Trace written by micro16 --trace");
+    arg_parser.add_argument("--summary")
+        .help("Only print totals and the hottest addresses")
+        .default_value(false)
+        .implicit_value(true);
+    arg_parser.add_argument("--from")
+        .help("Only records with IP at or after this address")
+        .default_value(std::string{"0"});
+    arg_parser.add_argument("--to")
+        .help("Only records with IP at or before this address")
+        .default_value(std::string{"0xffff"});
+    arg_parser.add_argument("--register")
+        .help("Only records that changed this register (W0-W3, SP or CR)");
+    arg_parser.add_argument("--limit")
+        .help("Print at most this number of records")
+        .scan<'i', int>()
+        .default_value(-1);
+    arg_parser.add_argument("--debug-info")
+        .help("Debug info written by micro16_asm, used to show labels and source lines");
+
+    try {
+        arg_parser.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << arg_parser;
+        return -1;
+    }
+
+    auto register_filter = arg_parser.present("--register");
+    auto limit = arg_parser.get<int>("--limit");
+    auto summary_only = arg_parser.get<bool>("--summary");
+
+    try {
+        auto from = parse_address(arg_parser, "--from");
+        auto to = parse_address(arg_parser, "--to");
+        auto debug_info = std::optional<DebugInfo>{};
+        if (auto debug_info_file = arg_parser.present("--debug-info")) {
+            debug_info = DebugInfo::from_file(*debug_info_file);
+        }
+        auto reader = TraceReader{arg_parser.get<std::string>("trace_file")};
+        auto summary = Summary{};
+        auto record = TraceRecord{};
+        auto n_printed = 0;
+        for (auto index = uint64_t{0}; reader.next(record); ++index) {
+            if (record.IP < from || record.IP > to) {
+                continue;
+            }
+            if (register_filter && traced_register_name(record.changed_register) != *register_filter) {
+                continue;
+            }
+            if (summary_only) {
+                summary.add(record);
+                continue;
+            }
+            if (n_printed == limit) {
+                break;
+            }
+            print_record(std::cout, index, record, debug_info);
+            n_printed += 1;
+        }
+        if (summary_only) {
+            summary.print(std::cout, debug_info, 20);
+        }
+    } catch (std::runtime_error const& err) {
+        std::cerr << err.what() << "\n";
+        return -1;
+    }
+
+    return 0;
+}
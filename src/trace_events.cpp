@@ -0,0 +1,196 @@
+#include <trace_events.hpp>
+#include <array>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    struct Event {
+        char const* name;
+        char phase;
+        int64_t timestamp;
+        int64_t duration;
+        char const* arg_name;
+        int64_t arg;
+    };
+
+    // Only its own thread appends to a buffer. Chunks are never moved, and
+    // `size` is published after the event is written, so the exporter can
+    // read the first `size` events at any time.
+    struct ThreadBuffer {
+        static constexpr auto CHUNK_SIZE = std::size_t{4096};
+        static constexpr auto N_CHUNKS = std::size_t{1024};
+
+        int thread_id;
+        std::string thread_name;
+        std::array<std::unique_ptr<Event[]>, N_CHUNKS> chunks;
+        std::atomic<std::size_t> size{0};
+
+        void push(Event const& event)
+        {
+            auto i = this->size.load(std::memory_order_relaxed);
+            if (i == CHUNK_SIZE * N_CHUNKS) {
+                return;
+            }
+            auto& chunk = this->chunks[i / CHUNK_SIZE];
+            if (!chunk) {
+                chunk = std::make_unique<Event[]>(CHUNK_SIZE);
+            }
+            chunk[i % CHUNK_SIZE] = event;
+            this->size.store(i + 1, std::memory_order_release);
+        }
+
+        Event const& at(std::size_t i) const
+        {
+            return this->chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+        }
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+    thread_local ThreadBuffer* current_thread_buffer = nullptr;
+
+    ThreadBuffer& thread_buffer()
+    {
+        if (current_thread_buffer == nullptr) {
+            std::scoped_lock _{registry_mutex};
+            thread_buffers.push_back(std::make_unique<ThreadBuffer>());
+            current_thread_buffer = thread_buffers.back().get();
+            current_thread_buffer->thread_id = int(thread_buffers.size());
+        }
+        return *current_thread_buffer;
+    }
+
+
+    void write_microseconds(std::ostream& os, int64_t ns)
+    {
+        os << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+    }
+}
+
+TraceEvents::Scope::Scope(char const* name)
+    : name(name)
+    , start(TraceEvents::is_enabled() ? TraceEvents::now() : 0)
+{
+}
+
+TraceEvents::Scope::~Scope()
+{
+    if (TraceEvents::is_enabled()) {
+        TraceEvents::complete(this->name, this->start, TraceEvents::now());
+    }
+}
+
+void TraceEvents::enable()
+{
+    (void) TraceEvents::now();
+    enabled = true;
+}
+
+void TraceEvents::disable()
+{
+    enabled = false;
+}
+
+int64_t TraceEvents::now()
+{
+    static auto const epoch = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - epoch;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void TraceEvents::set_thread_name(std::string const& name)
+{
+    if (!TraceEvents::is_enabled()) {
+        return;
+    }
+    auto& buffer = thread_buffer();
+    std::scoped_lock _{registry_mutex};
+    buffer.thread_name = name;
+}
+
+void TraceEvents::instant(char const* name, char const* arg_name, int64_t arg)
+{
+    if (TraceEvents::is_enabled()) {
+        thread_buffer().push({name, 'i', TraceEvents::now(), 0, arg_name, arg});
+    }
+}
+
+void TraceEvents::complete(char const* name, int64_t start, int64_t end, char const* arg_name, int64_t arg)
+{
+    if (TraceEvents::is_enabled()) {
+        thread_buffer().push({name, 'X', start, end - start, arg_name, arg});
+    }
+}
+
+void TraceEvents::begin(char const* name, char const* arg_name, int64_t arg)
+{
+    if (TraceEvents::is_enabled()) {
+        thread_buffer().push({name, 'B', TraceEvents::now(), 0, arg_name, arg});
+    }
+}
+
+void TraceEvents::end(char const* name)
+{
+    if (TraceEvents::is_enabled()) {
+        thread_buffer().push({name, 'E', TraceEvents::now(), 0, nullptr, 0});
+    }
+}
+
+void TraceEvents::write_json(std::ostream& os)
+{
+    std::scoped_lock _{registry_mutex};
+    auto first = true;
+    auto separator = [&first, &os]() {
+        os << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    os << "{\"traceEvents\": [";
+    for (auto&& buffer : thread_buffers) {
+        if (!buffer->thread_name.empty()) {
+            separator();
+            os << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread_id;
+            os << ", \"args\": {\"name\": \"" << buffer->thread_name << "\"}}";
+        }
+        auto size = buffer->size.load(std::memory_order_acquire);
+        for (auto i = std::size_t{0}; i < size; ++i) {
+            auto&& event = buffer->at(i);
+            separator();
+            os << "{\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase << "\"";
+            os << ", \"pid\": 1, \"tid\": " << buffer->thread_id << ", \"ts\": ";
+            write_microseconds(os, event.timestamp);
+            if (event.phase == 'X') {
+                os << ", \"dur\": ";
+                write_microseconds(os, event.duration);
+            }
+            if (event.phase == 'i') {
+                os << ", \"s\": \"t\"";
+            }
+            if (event.arg_name != nullptr) {
+                os << ", \"args\": {\"" << event.arg_name << "\": " << event.arg << "}";
+            }
+            os << "}";
+        }
+    }
+    os << "\n]}\n";
+}
+
+TraceEventsProbe::TraceEventsProbe()
+    : expected_IP(0)
+    , n_nested_handlers(0)
+    , n_instructions(0)
+    , slice_start(TraceEvents::now())
+{
+}
+
+void TraceEventsProbe::end_slice()
+{
+    auto now = TraceEvents::now();
+    if (this->n_instructions != 0) {
+        TraceEvents::complete("run", this->slice_start, now, "instructions", this->n_instructions);
+    }
+    this->n_instructions = 0;
+    this->slice_start = now;
+}
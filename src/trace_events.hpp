@@ -0,0 +1,117 @@
+#ifndef MICRO16_TRACE_EVENTS_HPP
+#define MICRO16_TRACE_EVENTS_HPP
+
+#include <specs.h>
+#include <isa.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Timeline of what the emulator threads are doing, exported as Chrome
+// trace-event JSON (chrome://tracing, https://ui.perfetto.dev).
+//
+// Each thread appends to its own buffer, so recording takes no locks. Nothing
+// is recorded until enable() is called, and disabled events only cost a
+// relaxed load. Event and argument names must be string literals.
+class TraceEvents {
+public:
+    // Records a complete event from its construction to its destruction
+    class Scope {
+    public:
+        explicit Scope(char const* name);
+        ~Scope();
+
+    private:
+        char const* name;
+        int64_t start;
+    };
+
+    static void enable();
+    static void disable();
+    static inline bool is_enabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Nanoseconds since the first call
+    static int64_t now();
+
+    static void set_thread_name(std::string const& name);
+    static void instant(char const* name, char const* arg_name = nullptr, int64_t arg = 0);
+    static void complete(char const* name, int64_t start, int64_t end, char const* arg_name = nullptr, int64_t arg = 0);
+    static void begin(char const* name, char const* arg_name = nullptr, int64_t arg = 0);
+    static void end(char const* name);
+
+    // Can be called while other threads are still recording
+    static void write_json(std::ostream& os);
+
+private:
+    static inline std::atomic<bool> enabled{false};
+};
+
+// Execution probe recording the CPU timeline: a slice every SLICE_SIZE
+// instructions, and the time spent in each interrupt handler (from its entry,
+// detected as the IP not being the one left by the previous instruction, or
+// as an illegal instruction trap, to its RETI). Use it on Micro16::run(probe)
+// together with TraceEvents::enable().
+class TraceEventsProbe {
+public:
+    static constexpr auto SLICE_SIZE = 100000;
+
+    TraceEventsProbe();
+
+    inline void on_instruction(Address IP, Instruction instruction, Address next_IP)
+    {
+        if (IP != this->expected_IP) {
+            TraceEvents::begin("interrupt handler", "address", IP);
+            this->n_nested_handlers += 1;
+        }
+        switch (instruction >> 8) {
+            case RETI_CODE:
+                if (this->n_nested_handlers > 0) {
+                    TraceEvents::end("interrupt handler");
+                    this->n_nested_handlers -= 1;
+                }
+                break;
+            case CALL_CODE:
+            case RET_CODE:
+            case JMP_CODE:
+            case BRE_CODE:
+            case BRNE_CODE:
+            case BRL_CODE:
+            case BRH_CODE:
+            case BRNZ_CODE:
+                break;
+            default: {
+                // Same as in SamplingProfiler: the IP moved elsewhere because
+                // the instruction is illegal and the CPU entered the trap handler
+                auto size = (instruction >> 8) == LDI_CODE ? 4 : 2;
+                if (next_IP != Address(IP + size) && next_IP != IP) {
+                    TraceEvents::begin("interrupt handler", "address", next_IP);
+                    this->n_nested_handlers += 1;
+                }
+                break;
+            }
+        }
+        this->expected_IP = next_IP;
+
+        this->n_instructions += 1;
+        if (this->n_instructions == SLICE_SIZE) {
+            this->end_slice();
+        }
+    }
+
+    // Records the current slice, even if it has less than SLICE_SIZE
+    // instructions. Call it from the CPU thread when run() returns.
+    void end_slice();
+
+private:
+    Address expected_IP;
+    int n_nested_handlers;
+    int64_t n_instructions;
+    int64_t slice_start;
+};
+
+#endif //MICRO16_TRACE_EVENTS_HPP